@@ -158,6 +158,19 @@ VM_EXPORT
 			return texture;
 		}
 
+		template <typename T>
+		Texture3D<T> create_texture( HostBuffer3D<T> const &buf ) const
+		{
+			auto opts = Texture3DOptions{}
+						  .set_device( device )
+						  .set_dim( buf.dim() )
+						  .set_opts( cufx::Texture::Options::as_array()
+									   .set_address_mode( cufx::Texture::AddressMode::Clamp ) );
+			Texture3D<T> texture( opts );
+			texture.source( buf.data() );
+			return texture;
+		}
+
 		Image<typename Shader::Pixel> create_film() const
 		{
 			auto img_opts = ImageOptions{}
@@ -9,10 +9,29 @@ VM_BEGIN_MODULE( hydrant )
 
 VM_EXPORT
 {
+	/* sort-last splits the volume among ranks, sort-first splits the screen
+	   among ranks that each hold the whole volume */
+	VM_ENUM( Distribution,
+			 SortLast, SortFirst );
+
 	struct BasicRendererParams : vm::json::Serializable<BasicRendererParams>
 	{
 		VM_JSON_FIELD( ShadingDevice, device ) = ShadingDevice::Cuda;
 		VM_JSON_FIELD( int, comm_rank ) = 0;
+		VM_JSON_FIELD( Distribution, distribution ) = Distribution::SortLast;
+		/* edge length in pixels of a sort-first tile */
+		VM_JSON_FIELD( int, tile_size ) = 64;
+		/* exchange group size of sort-last compositing, 2 is binary swap. other values
+		   are rounded down to a power of two, at least 2 */
+		VM_JSON_FIELD( int, compositing_radix ) = 2;
+		/* exchange first round pieces while the rest of the frame renders */
+		VM_JSON_FIELD( bool, streaming_compositing ) = false;
+		/* blend within each host through shared memory before the network */
+		VM_JSON_FIELD( bool, hierarchical_compositing ) = false;
+		/* load gain a kd split move needs per rank's worth of bricks it migrates */
+		VM_JSON_FIELD( float, kd_move_cost ) = .2f;
+		/* host copies of decoded blocks that migrate with kd splits, 0 disables */
+		VM_JSON_FIELD( int, migration_cache_mb ) = 0;
 		VM_JSON_FIELD( float, sample_rate ) = 1.0;
 		VM_JSON_FIELD( int, max_steps ) = 4000000;
 		VM_JSON_FIELD( vec3, clear_color ) = vec3( 0 );
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <VMUtils/attributes.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/core/scene.hpp>
+#include <hydrant/bridge/buffer_3d.hpp>
+#include <hydrant/dyn_kd_tree.hpp>
+#include <hydrant/frame_sync.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	struct BlockCostOptions
+	{
+		/* cost of an on screen empty block relative to an occupied one */
+		VM_DEFINE_ATTRIBUTE( float, empty_weight ) = .05f;
+		/* weight of the latest measured to predicted time ratio of a rank */
+		VM_DEFINE_ATTRIBUTE( float, calib_rate ) = .2f;
+	};
+
+	/* predicts the render work of each block as the screen area of its bounding
+	   sphere, zero off screen and scaled down for blocks the skip field leaps
+	   over. measured render times calibrate the prediction per rank, ranks
+	   that still page blocks in are left out since they render coarser data */
+	struct BlockCostModel
+	{
+		BlockCostModel( ivec3 const &dim, int nranks,
+						BlockCostOptions const &opts = BlockCostOptions{} ) :
+		  dim( dim ),
+		  opts( opts ),
+		  owner( uvec3( dim ) ),
+		  calib( nranks, 1. ),
+		  predicted( nranks, 0. )
+		{
+		}
+
+	public:
+		/* records are those gathered this frame, their render times belong to the
+		   frame predicted by the last call. iet maps world to block space */
+		template <typename Occupied>
+		void rebalance( DynKdTree &kd_tree, mat4 const &iet,
+						std::vector<FrameRecord> const &records, float aspect,
+						Occupied const &occupied, KdBalanceOptions const &kd_opts )
+		{
+			calibrate( records );
+
+			auto &camera = records[ 0 ].camera;
+			auto block_to_camera = inverse( iet * camera.get_ivt() );
+			auto regions = kd_tree.regions();
+			for ( int i = 0; i != regions.size(); ++i ) {
+				auto &box = regions[ i ];
+				for ( auto z = box.min.z; z < box.max.z; ++z ) {
+					for ( auto y = box.min.y; y < box.max.y; ++y ) {
+						for ( auto x = box.min.x; x < box.max.x; ++x ) {
+							owner[ uvec3( x, y, z ) ] = i;
+						}
+					}
+				}
+			}
+
+			std::fill( predicted.begin(), predicted.end(), 0. );
+			work.build( dim, [&]( uvec3 const &idx ) {
+				auto c = cost( camera, block_to_camera, aspect, idx, occupied( idx ) );
+				auto i = owner[ idx ];
+				predicted[ i ] += c;
+				return c * calib[ i ];
+			} );
+			bricks.build( dim, [&]( uvec3 const &idx ) { return occupied( idx ) ? 1. : 0.; } );
+			kd_tree.balance( work, bricks, kd_opts );
+		}
+
+	private:
+		void calibrate( std::vector<FrameRecord> const &records )
+		{
+			std::vector<double> ratio( calib.size(), 0. );
+			double sum = 0.;
+			int n = 0;
+			for ( int i = 0; i != calib.size(); ++i ) {
+				if ( records[ i ].pending_blocks || !records[ i ].render_t || predicted[ i ] <= 0. ) continue;
+				ratio[ i ] = records[ i ].render_t / predicted[ i ];
+				sum += ratio[ i ];
+				n += 1;
+			}
+			if ( n < 2 ) return;
+			for ( int i = 0; i != calib.size(); ++i ) {
+				if ( ratio[ i ] > 0. ) {
+					calib[ i ] += opts.calib_rate * ( ratio[ i ] * n / sum - calib[ i ] );
+				}
+			}
+		}
+
+		double cost( Camera const &camera, mat4 const &trans, float aspect,
+					 uvec3 const &idx, bool occ ) const
+		{
+			const auto radius = .8660254f;
+			auto weight = occ ? 1. : opts.empty_weight;
+			/* orthographic cameras see every block at the same size */
+			if ( isinf( camera.ctg_fovy_2 ) ) return weight;
+			vec3 c = trans * vec4( vec3( idx ) + .5f, 1.f );
+			auto z = -c.z;
+			if ( z < -radius ) return 0.;
+			if ( z <= radius ) return weight * 4. * aspect;
+			auto k = camera.ctg_fovy_2 / z;
+			auto r = radius * k;
+			auto p = abs( vec2( c ) * k );
+			if ( p.x - r > aspect || p.y - r > 1.f ) return 0.;
+			return weight * std::min( 3.1415927 * r * r, 4. * aspect );
+		}
+
+	private:
+		ivec3 dim;
+		BlockCostOptions opts;
+		HostBuffer3D<int> owner;
+		std::vector<double> calib, predicted;
+		BoxSum work, bricks;
+	};
+}
+
+VM_END_MODULE()
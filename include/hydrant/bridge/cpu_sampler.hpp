@@ -15,6 +15,8 @@ public:
 	T sample_2d_untyped( glm::vec<2, E> const &p ) const;
 	template <typename T, typename E>
 	T sample_1d_untyped( E x ) const;
+	template <typename T, typename E>
+	T sample_3d_grad_untyped( glm::vec<3, E> const &p, glm::vec3 &grad, bool smooth ) const;
 };
 
 VM_EXPORT
@@ -41,6 +43,73 @@ VM_EXPORT
 
 		T sample_1d( float x ) const { return sample_impl( x ); }
 
+		/* value and analytic gradient of the trilinear interpolant from a single
+		   8 texel fetch, the gradient is taken with respect to x */
+		template <typename G>
+		T sample_3d_grad( glm::vec3 const &x, G &grad ) const
+		{
+			auto fx = opts.normalize_coords ? fdim * x : x;
+			switch ( opts.address_mode ) {
+			case cufx::Texture::AddressMode::Clamp:
+				fx = clamp( fx, glm::vec3( 0 ), fdim );
+				break;
+			case cufx::Texture::AddressMode::Border:
+				if ( !in_bounds( fx, fdim ) ) {
+					grad = G( 0 );
+					return T( 0 );
+				}
+				break;
+			case cufx::Texture::AddressMode::Mirror:
+			case cufx::Texture::AddressMode::Wrap:
+				fx = mod( fx, fdim );
+				break;
+			}
+			fx -= .5f;
+
+			auto flr = floor( fx );
+			auto a = fx - flr;
+			auto ix = clamp( ivec3( flr ), ivec3( 0 ), idim - 1 );
+			auto jx = clamp( ivec3( ceil( fx ) ), ivec3( 0 ), idim - 1 );
+
+			auto c000 = visit( { ix.x, ix.y, ix.z } ), c100 = visit( { jx.x, ix.y, ix.z } );
+			auto c010 = visit( { ix.x, jx.y, ix.z } ), c110 = visit( { jx.x, jx.y, ix.z } );
+			auto c001 = visit( { ix.x, ix.y, jx.z } ), c101 = visit( { jx.x, ix.y, jx.z } );
+			auto c011 = visit( { ix.x, jx.y, jx.z } ), c111 = visit( { jx.x, jx.y, jx.z } );
+
+			auto x00 = do_lerp( c000, c100, a.x );
+			auto x10 = do_lerp( c010, c110, a.x );
+			auto x01 = do_lerp( c001, c101, a.x );
+			auto x11 = do_lerp( c011, c111, a.x );
+			auto y0 = do_lerp( x00, x10, a.y );
+			auto y1 = do_lerp( x01, x11, a.y );
+
+			/* partial derivatives of the trilinear form */
+			grad.x = do_lerp( do_lerp( c100 - c000, c110 - c010, a.y ),
+							  do_lerp( c101 - c001, c111 - c011, a.y ), a.z );
+			grad.y = do_lerp( x10 - x00, x11 - x01, a.z );
+			grad.z = y1 - y0;
+			if ( opts.normalize_coords ) { grad *= fdim; }
+
+			return do_lerp( y0, y1, a.z );
+		}
+
+		/* averages the analytic gradient over the 2x2x2 texel neighbourhood for smoother normals */
+		template <typename G>
+		T sample_3d_grad_smooth( glm::vec3 const &x, G &grad ) const
+		{
+			auto h = opts.normalize_coords ? .5f / fdim : glm::vec3( .5f );
+			grad = G( 0 );
+			for ( int i = 0; i != 8; ++i ) {
+				auto o = glm::vec3( i & 1, ( i >> 1 ) & 1, ( i >> 2 ) & 1 ) * 2.f - 1.f;
+				G g;
+				sample_3d_grad( x + o * h, g );
+				grad += g;
+			}
+			grad /= 8.f;
+			G g;
+			return sample_3d_grad( x, g );
+		}
+
 	private:
 		template <typename U>
 		void get_dim( U &dst ) const
@@ -188,5 +257,12 @@ T ICpuSampler::sample_1d_untyped( E x ) const
 {
 	return static_cast<CpuSampler<T> const *>( this )->sample_1d( float( x ) );
 }
+template <typename T, typename E>
+T ICpuSampler::sample_3d_grad_untyped( glm::vec<3, E> const &p, glm::vec3 &grad, bool smooth ) const
+{
+	auto self = static_cast<CpuSampler<T> const *>( this );
+	return smooth ? self->sample_3d_grad_smooth( glm::vec3( p ), grad )
+				  : self->sample_3d_grad( glm::vec3( p ), grad );
+}
 
 VM_END_MODULE()
@@ -71,6 +71,23 @@ VM_EXPORT
 			return Helper::to( tex3D<typename Helper::type>( cu, p.x, p.y, p.z ) );
 #else
 			return cpu->sample_3d_untyped<T>( p );
+#endif
+		}
+		/* value and gradient with respect to p, analytic on the cpu, central
+		   differences of half width dt on the device */
+		template <typename T, typename E>
+		__host__ __device__ T
+		  sample_3d_grad( glm::vec<3, E> const &p, glm::vec3 &grad,
+						  float dt, bool smooth = false ) const
+		{
+#if CUFX_DEVICE_CODE
+			grad = glm::vec3( sample_3d<T>( p + glm::vec3( dt, 0, 0 ) ) - sample_3d<T>( p - glm::vec3( dt, 0, 0 ) ),
+							  sample_3d<T>( p + glm::vec3( 0, dt, 0 ) ) - sample_3d<T>( p - glm::vec3( 0, dt, 0 ) ),
+							  sample_3d<T>( p + glm::vec3( 0, 0, dt ) ) - sample_3d<T>( p - glm::vec3( 0, 0, dt ) ) ) /
+				   ( 2.f * dt );
+			return sample_3d<T>( p );
+#else
+			return cpu->sample_3d_grad_untyped<T>( p, grad, smooth );
 #endif
 		}
 		template <typename T, typename E>
@@ -0,0 +1,732 @@
+#pragma once
+
+#include <thread>
+#include <memory>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <mpi.h>
+#include <glog/logging.h>
+#include <cudafx/image.hpp>
+#include <VMUtils/attributes.hpp>
+#include <VMUtils/concepts.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/core/shader.hpp>
+#include <hydrant/core/raycaster.hpp>
+#include <hydrant/mpi_utils.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+/* splits [ 0, n ) into contiguous chunks over the shading threads */
+template <typename F>
+void parallel_chunks( ThreadPoolInfo const &pool, int n, F const &f )
+{
+	const int min_chunk = 4096;
+	auto nthreads = std::min( std::max( int( pool.nthreads ), 1 ),
+							  std::max( n / min_chunk, 1 ) );
+	if ( nthreads == 1 ) {
+		f( 0, n );
+		return;
+	}
+	std::vector<std::thread> threads;
+	for ( int i = 0; i < nthreads; ++i ) {
+		threads.emplace_back( [&, i] { f( n * i / nthreads, n * ( i + 1 ) / nthreads ); } );
+	}
+	for ( auto &t : threads ) { t.join(); }
+}
+
+/* blend ops may provide span( front, back, dst, n ) for a vectorized merge */
+template <typename Blend, typename P>
+auto blend_span( Blend const &blend, P const *front, P const *back, P *dst, int n, int )
+  -> decltype( blend.span( front, back, dst, n ), void() )
+{
+	blend.span( front, back, dst, n );
+}
+
+template <typename Blend, typename P>
+void blend_span( Blend const &blend, P const *front, P const *back, P *dst, int n, long )
+{
+	for ( int i = 0; i < n; ++i ) {
+		dst[ i ] = blend( front[ i ], back[ i ] );
+	}
+}
+
+/* a piece of the frame as the bounding rect of its non empty pixels, with
+   empty spans inside the rect run length encoded. the layout is a header,
+   the runs, then the non empty pixels back to back */
+struct SparseHeader
+{
+	int x0, y0, x1, y1;
+	int nruns;
+};
+
+/* skip empty pixels then take count pixels, in row major order of the rect */
+struct SparseRun
+{
+	int skip, count;
+};
+
+/* a run clipped to one row, off is relative to the start of the piece */
+struct SparseSegment
+{
+	int off, lit, count;
+};
+
+template <typename P>
+struct SparsePayload
+{
+	/* worst case size of a piece of n pixels */
+	static std::size_t capacity( int n )
+	{
+		return pixels_at( n / 2 + 1 ) + n * sizeof( P );
+	}
+
+	/* pixels start aligned after the runs */
+	static std::size_t pixels_at( int nruns )
+	{
+		auto off = sizeof( SparseHeader ) + nruns * sizeof( SparseRun );
+		return ( off + alignof( P ) - 1 ) / alignof( P ) * alignof( P );
+	}
+
+	template <typename Blend>
+	static void encode( P const *src, int width, int rows,
+						Blend const &blend, std::vector<char> &out )
+	{
+		SparseHeader hdr{ width, rows, 0, 0, 0 };
+		for ( int y = 0; y != rows; ++y ) {
+			auto line = src + y * width;
+			int x0 = 0, x1 = width;
+			while ( x0 != x1 && blend.empty( line[ x0 ] ) ) { ++x0; }
+			if ( x0 == x1 ) continue;
+			while ( blend.empty( line[ x1 - 1 ] ) ) { --x1; }
+			hdr.x0 = std::min( hdr.x0, x0 );
+			hdr.x1 = std::max( hdr.x1, x1 );
+			hdr.y0 = std::min( hdr.y0, y );
+			hdr.y1 = y + 1;
+		}
+
+		std::vector<SparseRun> runs;
+		int npixels = 0;
+		auto rw = hdr.x1 - hdr.x0;
+		auto run = SparseRun{ 0, 0 };
+		for ( int y = hdr.y0; y < hdr.y1; ++y ) {
+			auto line = src + y * width + hdr.x0;
+			for ( int x = 0; x != rw; ++x ) {
+				if ( blend.empty( line[ x ] ) ) {
+					if ( run.count ) {
+						runs.emplace_back( run );
+						run = SparseRun{ 0, 0 };
+					}
+					run.skip += 1;
+				} else {
+					run.count += 1;
+					npixels += 1;
+				}
+			}
+		}
+		if ( run.count ) { runs.emplace_back( run ); }
+		hdr.nruns = runs.size();
+
+		out.resize( pixels_at( hdr.nruns ) + npixels * sizeof( P ) );
+		memcpy( out.data(), &hdr, sizeof( hdr ) );
+		memcpy( out.data() + sizeof( hdr ), runs.data(), runs.size() * sizeof( SparseRun ) );
+		auto lit = reinterpret_cast<P *>( out.data() + pixels_at( hdr.nruns ) );
+		auto pos = 0;
+		for ( auto &r : runs ) {
+			pos += r.skip;
+			for ( int i = 0; i != r.count; ++i, ++pos ) {
+				*lit++ = src[ ( hdr.y0 + pos / rw ) * width + hdr.x0 + pos % rw ];
+			}
+		}
+	}
+
+	/* splits the runs of a payload at rect rows */
+	static P const *decode( char const *buf, int width,
+							std::vector<SparseSegment> &segs )
+	{
+		SparseHeader hdr;
+		memcpy( &hdr, buf, sizeof( hdr ) );
+		auto runs = reinterpret_cast<SparseRun const *>( buf + sizeof( hdr ) );
+		auto rw = hdr.x1 - hdr.x0;
+		segs.clear();
+		int pos = 0, lit = 0;
+		for ( int i = 0; i != hdr.nruns; ++i ) {
+			pos += runs[ i ].skip;
+			for ( int n = runs[ i ].count; n > 0; ) {
+				auto x = pos % rw;
+				auto count = std::min( n, rw - x );
+				segs.emplace_back( SparseSegment{
+				  ( hdr.y0 + pos / rw ) * width + hdr.x0 + x, lit, count } );
+				pos += count;
+				lit += count;
+				n -= count;
+			}
+		}
+		return reinterpret_cast<P const *>( buf + pixels_at( hdr.nruns ) );
+	}
+};
+
+/* ranks that share a host, with a shared memory window holding one frame
+   sized slot per rank, and a communicator of the node leaders. a node's
+   leader is its lowest rank, so rank 0 leads its node and the leaders */
+struct NodeGroup : vm::NoCopy, vm::NoMove
+{
+	NodeGroup( MpiComm const &comm ) :
+	  parent( comm.comm ),
+	  node_of( comm.size ),
+	  local_of( comm.size )
+	{
+		node.comm = leaders.comm = MPI_COMM_NULL;
+		MPI_Comm_split_type( comm.comm, MPI_COMM_TYPE_SHARED, comm.rank,
+							 MPI_INFO_NULL, &node.comm );
+		MPI_Comm_rank( node.comm, &node.rank );
+		MPI_Comm_size( node.comm, &node.size );
+		MPI_Comm_split( comm.comm, node.rank == 0 ? 0 : MPI_UNDEFINED, comm.rank,
+						&leaders.comm );
+		if ( node.rank == 0 ) {
+			MPI_Comm_rank( leaders.comm, &leaders.rank );
+			MPI_Comm_size( leaders.comm, &leaders.size );
+		}
+
+		/* every rank learns the node leader index and node rank of all ranks */
+		int ids[ 2 ] = { leaders.rank, node.rank };
+		MPI_Bcast( ids, 1, MPI_INT, 0, node.comm );
+		std::vector<int> all( 2 * comm.size );
+		MPI_Allgather( ids, 2, MPI_INT, all.data(), 2, MPI_INT, comm.comm );
+		index = ids[ 0 ];
+		nnodes = 0;
+		for ( int i = 0; i != comm.size; ++i ) {
+			node_of[ i ] = all[ 2 * i ];
+			local_of[ i ] = all[ 2 * i + 1 ];
+			nnodes = std::max( nnodes, node_of[ i ] + 1 );
+		}
+	}
+
+	~NodeGroup()
+	{
+		free_window();
+		MPI_Comm_free( &node.comm );
+		if ( leaders.comm != MPI_COMM_NULL ) {
+			MPI_Comm_free( &leaders.comm );
+		}
+	}
+
+public:
+	/* node members and node leaders in depth order, false if the ranks of some
+	   node are not adjacent in z_order and so cannot be blended first */
+	bool order( std::vector<int> const &z_order )
+	{
+		members.clear();
+		leader_order.clear();
+		std::vector<char> seen( nnodes, false );
+		for ( int i = 0; i != z_order.size(); ++i ) {
+			auto n = node_of[ z_order[ i ] ];
+			if ( i == 0 || n != node_of[ z_order[ i - 1 ] ] ) {
+				if ( seen[ n ] ) return false;
+				seen[ n ] = true;
+				leader_order.emplace_back( n );
+			}
+			if ( n == index ) {
+				members.emplace_back( local_of[ z_order[ i ] ] );
+			}
+		}
+		return true;
+	}
+
+	void reserve( std::size_t bytes )
+	{
+		if ( bytes == slot_bytes ) return;
+		free_window();
+		char *base;
+		MPI_Win_allocate_shared( bytes, 1, MPI_INFO_NULL, node.comm, &base, &win );
+		slots.resize( node.size );
+		for ( int i = 0; i != node.size; ++i ) {
+			MPI_Aint size;
+			int disp;
+			MPI_Win_shared_query( win, i, &size, &disp, &slots[ i ] );
+		}
+		MPI_Win_lock_all( MPI_MODE_NOCHECK, win );
+		slot_bytes = bytes;
+	}
+
+	/* slot writes before this are seen by all node members after it */
+	void sync()
+	{
+		MPI_Win_sync( win );
+		MPI_Barrier( node.comm );
+		MPI_Win_sync( win );
+	}
+
+private:
+	void free_window()
+	{
+		if ( slot_bytes == 0 ) return;
+		MPI_Win_unlock_all( win );
+		MPI_Win_free( &win );
+		slot_bytes = 0;
+	}
+
+public:
+	MPI_Comm parent;
+	MpiComm node, leaders;
+	/* node index of this rank, the leader's rank among leaders */
+	int index, nnodes;
+	/* node leader index and node rank of each rank */
+	std::vector<int> node_of, local_of;
+	std::vector<int> members, leader_order;
+	std::vector<void *> slots;
+
+private:
+	MPI_Win win;
+	std::size_t slot_bytes = 0;
+};
+
+VM_EXPORT
+{
+	struct CompositingOptions
+	{
+		/* members per exchange group, 2 is binary swap */
+		VM_DEFINE_ATTRIBUTE( int, radix ) = 2;
+		/* render the first round pieces one by one and exchange them meanwhile */
+		VM_DEFINE_ATTRIBUTE( bool, streaming ) = false;
+		/* blend within each host through shared memory first, then only node
+		   leaders exchange over the network */
+		VM_DEFINE_ATTRIBUTE( bool, hierarchical ) = false;
+	};
+
+	/* rows [ y0, y1 ) of the frame */
+	struct CompositingRegion
+	{
+		int y0, y1;
+
+	public:
+		int rows() const { return y1 - y0; }
+
+		CompositingRegion piece( int i, int k ) const
+		{
+			auto n = rows();
+			return CompositingRegion{ y0 + n * i / k, y0 + n * ( i + 1 ) / k };
+		}
+	};
+
+	/* zeroes the pixels of a fetched image that a viewport left untouched */
+	template <typename P>
+	void clear_outside( cufx::ImageView<P> &img, Viewport const &vp )
+	{
+		auto w = img.width();
+		for ( int y = 0; y != img.height(); ++y ) {
+			auto line = &img.at_host( 0, y );
+			if ( y < vp.min.y || y >= vp.max.y ) {
+				memset( line, 0, w * sizeof( P ) );
+			} else {
+				memset( line, 0, vp.min.x * sizeof( P ) );
+				memset( line + vp.max.x, 0, ( w - vp.max.x ) * sizeof( P ) );
+			}
+		}
+	}
+
+	/* radix-k sort-last compositing of per rank images that are ordered front to
+	   back by z_order. blend( front, back ) must be associative, its identity must
+	   be all zero bytes and blend.empty( p ) must hold only for it, empty pixels
+	   are never sent. ranks beyond
+	   the largest power of two are folded into their depth neighbour first, rank 0
+	   gathers the converted frame. hierarchical compositing blends each node's
+	   ranks first when they are adjacent in depth order, as kd subtrees are */
+	template <typename P>
+	struct SortLastCompositor
+	{
+		SortLastCompositor()
+		{
+			pool.nthreads = std::thread::hardware_concurrency();
+		}
+
+	public:
+		template <typename Blend, typename Convert>
+		void composite( cufx::ImageView<P> &local,
+						cufx::ImageView<cufx::StdByte3Pixel> &frame,
+						MpiComm const &comm,
+						std::vector<int> const &z_order,
+						CompositingOptions const &opts,
+						Blend const &blend,
+						Convert const &convert )
+		{
+			width = local.width();
+			height = local.height();
+			if ( opts.hierarchical && comm.size > 1 ) {
+				if ( !nodes || nodes->parent != comm.comm ) {
+					nodes.reset( new NodeGroup( comm ) );
+				}
+				if ( nodes->nnodes < comm.size && nodes->order( z_order ) ) {
+					composite_nodes( local, frame, z_order, opts, blend, convert );
+					return;
+				}
+			}
+			schedule( comm.size, opts.radix );
+
+			/* virtual rank is the position in depth order */
+			auto v = int( std::find( z_order.begin(), z_order.end(), comm.rank ) -
+						  z_order.begin() );
+			auto n_fold = comm.size - active;
+			auto id = -1;
+			if ( v < 2 * n_fold ) {
+				auto full = CompositingRegion{ 0, height };
+				if ( v & 1 ) {
+					send.resize( 1 );
+					SparsePayload<P>::encode( row( local, 0 ), width, height, blend, send[ 0 ] );
+					MPI_Send( send[ 0 ].data(), send[ 0 ].size(), MPI_CHAR,
+							  z_order[ v - 1 ], 0, comm.comm );
+				} else {
+					recv.resize( 1 );
+					recv[ 0 ].resize( SparsePayload<P>::capacity( width * height ) );
+					MPI_Recv( recv[ 0 ].data(), recv[ 0 ].size(), MPI_CHAR,
+							  z_order[ v + 1 ], 0, comm.comm, MPI_STATUS_IGNORE );
+					merge( local, full, recv[ 0 ].data(), false, blend );
+					id = v / 2;
+				}
+			} else {
+				id = v - n_fold;
+			}
+
+			if ( id >= 0 ) {
+				exchange( local, comm, z_order, id, blend );
+			}
+			gather( local, frame, comm, z_order, id, convert );
+		}
+
+		/* streaming composite, returns the first round pieces in render order
+		   with the piece this rank keeps first. each rendered piece is handed to
+		   stream_piece, which sends it and merges whatever arrived meanwhile.
+		   ranks that fold or run alone get a single full frame piece */
+		std::vector<CompositingRegion> const &stream_begin( int width, int height,
+															MpiComm const &comm,
+															std::vector<int> const &z_order,
+															CompositingOptions const &opts )
+		{
+			this->width = width;
+			this->height = height;
+			schedule( comm.size, opts.radix );
+			stream.opts = opts;
+			stream.pieces.clear();
+			stream.members.clear();
+
+			auto full = CompositingRegion{ 0, height };
+			auto v = int( std::find( z_order.begin(), z_order.end(), comm.rank ) -
+						  z_order.begin() );
+			auto n_fold = comm.size - active;
+			stream.enabled = v >= 2 * n_fold && !radices.empty() && !opts.hierarchical;
+			if ( !stream.enabled ) {
+				stream.pieces.emplace_back( full );
+				return stream.pieces;
+			}
+
+			auto k = radices[ 0 ];
+			stream.id = v - n_fold;
+			stream.j = stream.id % k;
+			stream.lo = stream.hi = stream.j;
+			stream.peers.resize( k );
+			stream.arrived.assign( k, false );
+			stream.recvs.assign( k, MPI_REQUEST_NULL );
+			stream.sends.clear();
+			send.resize( k );
+			recv.resize( k );
+			auto mine = full.piece( stream.j, k );
+			for ( int i = 0; i != k; ++i ) {
+				stream.peers[ i ] = rank_of( z_order, stream.id - stream.j + i );
+				if ( i == stream.j ) continue;
+				recv[ i ].resize( SparsePayload<P>::capacity( width * mine.rows() ) );
+				MPI_Irecv( recv[ i ].data(), recv[ i ].size(), MPI_CHAR,
+						   stream.peers[ i ], 1, comm.comm, &stream.recvs[ i ] );
+			}
+			for ( int n = 0; n != k; ++n ) {
+				auto i = ( stream.j + n ) % k;
+				stream.pieces.emplace_back( full.piece( i, k ) );
+				stream.members.emplace_back( i );
+			}
+			return stream.pieces;
+		}
+
+		/* the idx-th piece returned by stream_begin is rendered into local */
+		template <typename Blend>
+		void stream_piece( cufx::ImageView<P> &local, MpiComm const &comm,
+						   int idx, Blend const &blend )
+		{
+			if ( !stream.enabled ) return;
+			auto i = stream.members[ idx ];
+			if ( i != stream.j ) {
+				auto &piece = stream.pieces[ idx ];
+				SparsePayload<P>::encode( row( local, piece.y0 ), width, piece.rows(),
+										  blend, send[ i ] );
+				stream.sends.emplace_back();
+				MPI_Isend( send[ i ].data(), send[ i ].size(), MPI_CHAR,
+						   stream.peers[ i ], 1, comm.comm, &stream.sends.back() );
+			}
+			progress( local, false, blend );
+		}
+
+		/* all pieces are rendered, finishes the first round then composites as usual */
+		template <typename Blend, typename Convert>
+		void stream_end( cufx::ImageView<P> &local,
+						 cufx::ImageView<cufx::StdByte3Pixel> &frame,
+						 MpiComm const &comm,
+						 std::vector<int> const &z_order,
+						 Blend const &blend,
+						 Convert const &convert )
+		{
+			if ( !stream.enabled ) {
+				composite( local, frame, comm, z_order, stream.opts, blend, convert );
+				return;
+			}
+			progress( local, true, blend );
+			MPI_Waitall( stream.sends.size(), stream.sends.data(), MPI_STATUSES_IGNORE );
+			exchange( local, comm, z_order, stream.id, blend, 1 );
+			gather( local, frame, comm, z_order, stream.id, convert );
+		}
+
+	private:
+		/* every node member blends one band of rows over all slots into the
+		   leader's slot, then the leaders composite across nodes */
+		template <typename Blend, typename Convert>
+		void composite_nodes( cufx::ImageView<P> &local,
+							  cufx::ImageView<cufx::StdByte3Pixel> &frame,
+							  std::vector<int> const &z_order,
+							  CompositingOptions const &opts,
+							  Blend const &blend,
+							  Convert const &convert )
+		{
+			auto &g = *nodes;
+			auto slot = [&]( int i ) { return reinterpret_cast<P *>( g.slots[ i ] ); };
+			g.reserve( width * height * sizeof( P ) );
+			memcpy( slot( g.node.rank ), row( local, 0 ), width * height * sizeof( P ) );
+			g.sync();
+
+			auto band = CompositingRegion{ 0, height }.piece( g.node.rank, g.node.size );
+			auto off = band.y0 * width;
+			acc.resize( band.rows() * width );
+			parallel_chunks( pool, int( acc.size() ), [&]( int i0, int i1 ) {
+				auto dst = acc.data() + i0;
+				memcpy( dst, slot( g.members[ 0 ] ) + off + i0, ( i1 - i0 ) * sizeof( P ) );
+				for ( int m = 1; m < g.members.size(); ++m ) {
+					blend_span( blend, dst, slot( g.members[ m ] ) + off + i0, dst, i1 - i0, 0 );
+				}
+			} );
+			memcpy( slot( 0 ) + off, acc.data(), acc.size() * sizeof( P ) );
+			g.sync();
+
+			if ( g.node.rank != 0 ) return;
+			memcpy( row( local, 0 ), slot( 0 ), width * height * sizeof( P ) );
+			auto leader_opts = opts;
+			leader_opts.set_hierarchical( false );
+			composite( local, frame, g.leaders, g.leader_order, leader_opts, blend, convert );
+		}
+
+		/* merges arrived pieces adjacent to the merged member range [ lo, hi ],
+		   which keeps the blend order of a plain exchange round */
+		template <typename Blend>
+		void progress( cufx::ImageView<P> &local, bool wait, Blend const &blend )
+		{
+			auto k = radices[ 0 ];
+			auto mine = CompositingRegion{ 0, height }.piece( stream.j, k );
+			std::vector<int> done( k );
+			while ( stream.lo != 0 || stream.hi != k - 1 ) {
+				int ndone = 0;
+				if ( wait ) {
+					MPI_Waitsome( k, stream.recvs.data(), &ndone, done.data(), MPI_STATUSES_IGNORE );
+				} else {
+					MPI_Testsome( k, stream.recvs.data(), &ndone, done.data(), MPI_STATUSES_IGNORE );
+				}
+				for ( int n = 0; n < ndone; ++n ) {
+					stream.arrived[ done[ n ] ] = true;
+				}
+				while ( stream.lo != 0 && stream.arrived[ stream.lo - 1 ] ) {
+					merge( local, mine, recv[ --stream.lo ].data(), true, blend );
+				}
+				while ( stream.hi != k - 1 && stream.arrived[ stream.hi + 1 ] ) {
+					merge( local, mine, recv[ ++stream.hi ].data(), false, blend );
+				}
+				if ( !wait ) break;
+			}
+		}
+
+		void schedule( int size, int radix )
+		{
+			active = 1;
+			while ( active * 2 <= size ) { active *= 2; }
+			/* groups must split the power of two active ranks evenly */
+			int k = 2;
+			while ( k * 2 <= std::max( radix, 2 ) ) { k *= 2; }
+			if ( k != radix && radix != warned_radix ) {
+				LOG( WARNING ) << vm::fmt( "compositing_radix {} is not a power of two >= 2, using {}", radix, k );
+				warned_radix = radix;
+			}
+			radices.clear();
+			for ( int n = 1; n < active; n *= radices.back() ) {
+				radices.emplace_back( std::min( k, active / n ) );
+			}
+		}
+
+		int rank_of( std::vector<int> const &z_order, int id ) const
+		{
+			auto n_fold = int( z_order.size() ) - active;
+			return id < n_fold ? z_order[ 2 * id ] : z_order[ id + n_fold ];
+		}
+
+		/* the rows an active rank owns after all rounds */
+		CompositingRegion region_of( int id ) const
+		{
+			auto region = CompositingRegion{ 0, height };
+			int stride = 1;
+			for ( auto k : radices ) {
+				region = region.piece( id / stride % k, k );
+				stride *= k;
+			}
+			return region;
+		}
+
+		template <typename Blend>
+		void exchange( cufx::ImageView<P> &local,
+					   MpiComm const &comm,
+					   std::vector<int> const &z_order,
+					   int id, Blend const &blend, int first = 0 )
+		{
+			auto region = CompositingRegion{ 0, height };
+			int stride = 1;
+			int tag = 1;
+			for ( auto k : radices ) {
+				auto j = id / stride % k;
+				if ( tag <= first ) {
+					/* round already done by streaming */
+					region = region.piece( j, k );
+					stride *= k;
+					tag += 1;
+					continue;
+				}
+				auto base = id - j * stride;
+				auto mine = region.piece( j, k );
+				send.resize( k );
+				recv.resize( k );
+
+				std::vector<MPI_Request> rs;
+				rs.reserve( 2 * ( k - 1 ) );
+				for ( int i = 0; i != k; ++i ) {
+					if ( i == j ) continue;
+					auto dst = rank_of( z_order, base + i * stride );
+					recv[ i ].resize( SparsePayload<P>::capacity( width * mine.rows() ) );
+					rs.emplace_back();
+					MPI_Irecv( recv[ i ].data(), recv[ i ].size(), MPI_CHAR,
+							   dst, tag, comm.comm, &rs.back() );
+				}
+				for ( int i = 0; i != k; ++i ) {
+					if ( i == j ) continue;
+					auto dst = rank_of( z_order, base + i * stride );
+					auto piece = region.piece( i, k );
+					SparsePayload<P>::encode( row( local, piece.y0 ), width, piece.rows(),
+											  blend, send[ i ] );
+					rs.emplace_back();
+					MPI_Isend( send[ i ].data(), send[ i ].size(), MPI_CHAR,
+							   dst, tag, comm.comm, &rs.back() );
+				}
+				MPI_Waitall( rs.size(), rs.data(), MPI_STATUSES_IGNORE );
+
+				/* members nearer than this one go in front, the rest behind */
+				for ( int i = j - 1; i >= 0; --i ) {
+					merge( local, mine, recv[ i ].data(), true, blend );
+				}
+				for ( int i = j + 1; i != k; ++i ) {
+					merge( local, mine, recv[ i ].data(), false, blend );
+				}
+				region = mine;
+				stride *= k;
+				tag += 1;
+			}
+		}
+
+		template <typename Convert>
+		void gather( cufx::ImageView<P> &local,
+					 cufx::ImageView<cufx::StdByte3Pixel> &frame,
+					 MpiComm const &comm,
+					 std::vector<int> const &z_order,
+					 int id, Convert const &convert )
+		{
+			auto px_bytes = int( sizeof( cufx::StdByte3Pixel ) );
+			std::vector<int> counts( comm.size, 0 ), displs( comm.size, 0 );
+			for ( int i = 0; i != active; ++i ) {
+				auto rank = rank_of( z_order, i );
+				auto region = region_of( i );
+				counts[ rank ] = region.rows() * width * px_bytes;
+				displs[ rank ] = region.y0 * width * px_bytes;
+			}
+
+			rgb.clear();
+			if ( id >= 0 ) {
+				auto region = region_of( id );
+				rgb.resize( region.rows() * width );
+				auto src = row( local, region.y0 );
+				parallel_chunks( pool, int( rgb.size() ), [&]( int i0, int i1 ) {
+					for ( int i = i0; i < i1; ++i ) {
+						reinterpret_cast<uchar3 &>( rgb[ i ] ) = convert( src[ i ] );
+					}
+				} );
+			}
+			MPI_Gatherv( rgb.data(), int( rgb.size() ) * px_bytes, MPI_CHAR,
+						 comm.rank == 0 ? &frame.at_host( 0, 0 ) : nullptr,
+						 counts.data(), displs.data(), MPI_CHAR,
+						 0, comm.comm );
+		}
+
+		/* blends the non empty pixels of a payload in front of or behind local */
+		template <typename Blend>
+		void merge( cufx::ImageView<P> &local, CompositingRegion const &region,
+					char const *payload, bool front, Blend const &blend )
+		{
+			auto lit = SparsePayload<P>::decode( payload, width, segs );
+			if ( segs.empty() ) return;
+			auto dst = row( local, region.y0 );
+			auto &last = segs.back();
+			/* chunks over the packed pixels, each finds its first segment */
+			parallel_chunks( pool, last.lit + last.count, [&]( int i0, int i1 ) {
+				auto it = std::upper_bound( segs.begin(), segs.end(), i0,
+											[]( int i, SparseSegment const &seg ) { return i < seg.lit + seg.count; } );
+				for ( ; it != segs.end() && it->lit < i1; ++it ) {
+					auto l0 = std::max( it->lit, i0 );
+					auto l1 = std::min( it->lit + it->count, i1 );
+					auto d = dst + it->off + ( l0 - it->lit );
+					if ( front ) {
+						blend_span( blend, lit + l0, d, d, l1 - l0, 0 );
+					} else {
+						blend_span( blend, d, lit + l0, d, l1 - l0, 0 );
+					}
+				}
+			} );
+		}
+
+		P *row( cufx::ImageView<P> &local, int y ) const
+		{
+			return &local.at_host( 0, y );
+		}
+
+	private:
+		int width = 0, height = 0;
+		int active = 1;
+		ThreadPoolInfo pool;
+		std::vector<int> radices;
+		int warned_radix = 0;
+		std::vector<std::vector<char>> send, recv;
+		std::vector<SparseSegment> segs;
+		std::vector<cufx::StdByte3Pixel> rgb;
+		std::vector<P> acc;
+		std::unique_ptr<NodeGroup> nodes;
+		struct
+		{
+			bool enabled = false;
+			CompositingOptions opts;
+			int id = 0, j = 0, lo = 0, hi = 0;
+			std::vector<int> peers;
+			std::vector<char> arrived;
+			std::vector<MPI_Request> recvs, sends;
+			std::vector<CompositingRegion> pieces;
+			std::vector<int> members;
+		} stream;
+	};
+}
+
+VM_END_MODULE()
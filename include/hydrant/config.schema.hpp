@@ -8,10 +8,25 @@ VM_BEGIN_MODULE( hydrant )
 
 VM_EXPORT
 {
+	VM_ENUM( FrameFormat,
+			 Raw, Jpeg, H264 );
+
+	/* how the leader compresses frames for this session */
+	struct FrameEncodingConfig : vm::json::Serializable<FrameEncodingConfig>
+	{
+		VM_JSON_FIELD( FrameFormat, format ) = FrameFormat::Jpeg;
+		VM_JSON_FIELD( int, quality ) = 80;
+		/* target rate of h264 streams */
+		VM_JSON_FIELD( int, bitrate_kbps ) = 8000;
+		/* bumped by the client to get an h264 idr frame */
+		VM_JSON_FIELD( int, keyframe ) = 0;
+	};
+
 	struct RenderParamConfig : vm::json::Serializable<RenderParamConfig>
 	{
 		VM_JSON_FIELD( CameraConfig, camera );
 		VM_JSON_FIELD( RendererConfig, render );
+		VM_JSON_FIELD( FrameEncodingConfig, encoding ) = FrameEncodingConfig{};
 	};
 
 	struct Config : vm::json::Serializable<Config>
@@ -17,9 +17,20 @@ VM_BEGIN_MODULE( hydrant )
 
 VM_EXPORT
 {
+	/* pixels [ min, max ) of an image */
+	struct Viewport
+	{
+		VM_DEFINE_ATTRIBUTE( ivec2, min );
+		VM_DEFINE_ATTRIBUTE( ivec2, max );
+	};
+
 	struct RaycastingOptions
 	{
 		VM_DEFINE_ATTRIBUTE( vm::Option<cufx::Device>, device );
+		/* passes leave pixels outside untouched */
+		VM_DEFINE_ATTRIBUTE( vm::Option<Viewport>, viewport );
+		/* image pixel that maps to the first pixel of a fetch destination */
+		VM_DEFINE_ATTRIBUTE( ivec2, dst_offset ) = ivec2( 0 );
 	};
 
 	struct Raycaster
@@ -42,6 +53,7 @@ VM_EXPORT
 				kernel_args.image_desc.create_from_img( img, true );
 				fill_ray_emit_args( kernel_args, e, c );
 
+				crop( kernel_args, opts );
 				return cast_cuda_impl( &kernel_args, f, opts );
 			} else {
 				CpuRayEmitKernelArgs kernel_args;
@@ -49,6 +61,7 @@ VM_EXPORT
 				kernel_args.image_desc.create_from_img( img, false );
 				fill_ray_emit_args( kernel_args, e, c );
 
+				crop( kernel_args, opts );
 				return cast_cpu_impl( &kernel_args, f, opts );
 			}
 		}
@@ -63,12 +76,14 @@ VM_EXPORT
 				kernel_args.shading_pass = ShadingPass::RayMarch;
 				kernel_args.image_desc.create_from_img( img, true );
 
+				crop( kernel_args, opts );
 				return cast_cuda_impl( &kernel_args, f, opts );
 			} else {
 				CpuRayMarchKernelArgs kernel_args;
 				kernel_args.shading_pass = ShadingPass::RayMarch;
 				kernel_args.image_desc.create_from_img( img, false );
 
+				crop( kernel_args, opts );
 				return cast_cpu_impl( &kernel_args, f, opts );
 			}
 		}
@@ -87,6 +102,7 @@ VM_EXPORT
 				kernel_args.dst_desc.create_from_img( dst, true );
 				kernel_args.clear_color = saturate( clear_color );
 
+				crop( kernel_args, opts );
 				return cast_cuda_impl( &kernel_args, f, opts );
 			} else {
 				CpuPixelKernelArgs kernel_args;
@@ -95,6 +111,7 @@ VM_EXPORT
 				kernel_args.dst_desc.create_from_img( dst, false );
 				kernel_args.clear_color = saturate( clear_color );
 
+				crop( kernel_args, opts );
 				return cast_cpu_impl( &kernel_args, f, opts );
 			}
 		}
@@ -111,6 +128,7 @@ VM_EXPORT
 				kernel_args.image_desc.create_from_img( img, true );
 				kernel_args.dst_desc.create_from_img( dst, true );
 
+				crop( kernel_args, opts );
 				return cast_cuda_impl( &kernel_args, f, opts );
 			} else {
 				CpuFetchKernelArgs kernel_args;
@@ -118,11 +136,34 @@ VM_EXPORT
 				kernel_args.image_desc.create_from_img( img, false );
 				kernel_args.dst_desc.create_from_img( dst, false );
 
+				crop( kernel_args, opts );
 				return cast_cpu_impl( &kernel_args, f, opts );
 			}
 		}
 
 	private:
+		static void crop( BasicKernelArgs &args, RaycastingOptions const &opts )
+		{
+			if ( opts.viewport.has_value() ) {
+				auto &vp = opts.viewport.value();
+				args.image_desc.crop( vp.min, vp.max );
+			}
+		}
+
+		static void crop( BasicPixelKernelArgs &args, RaycastingOptions const &opts )
+		{
+			crop( static_cast<BasicKernelArgs &>( args ), opts );
+			args.dst_desc.origin = args.image_desc.origin;
+			args.dst_desc.extent = args.image_desc.extent;
+		}
+
+		static void crop( BasicFetchKernelArgs &args, RaycastingOptions const &opts )
+		{
+			crop( static_cast<BasicKernelArgs &>( args ), opts );
+			args.dst_desc.origin = args.image_desc.origin - opts.dst_offset;
+			args.dst_desc.extent = args.image_desc.extent;
+		}
+
 		void fill_ray_emit_args( BasicRayEmitKernelArgs &args,
 								 Exhibit const &e,
 								 Camera const &c ) const
@@ -162,9 +203,9 @@ VM_EXPORT
 			auto kernel_block_dim = dim3( 32, 32 );
 			args.launch_info = cufx::KernelLaunchInfo{}
 								 .set_device( opts.device.value() )
-								 .set_grid_dim( round_up_div( kernel_args->image_desc.resolution.x,
+								 .set_grid_dim( round_up_div( std::max( kernel_args->image_desc.extent.x, 1 ),
 															  kernel_block_dim.x ),
-												round_up_div( kernel_args->image_desc.resolution.y,
+												round_up_div( std::max( kernel_args->image_desc.extent.y, 1 ),
 															  kernel_block_dim.y ) )
 								 .set_block_dim( kernel_block_dim );
 
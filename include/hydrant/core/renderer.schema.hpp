@@ -8,15 +8,17 @@ VM_BEGIN_MODULE( hydrant )
 
 VM_EXPORT
 {
+	VM_ENUM( RealtimeRenderQuality,
+			 Lossless, Dynamic );
+
 	struct RendererConfig : vm::json::Serializable<RendererConfig>
 	{
 		VM_JSON_FIELD( glm::ivec2, resolution ) = { 512, 512 };
 		VM_JSON_FIELD( std::string, renderer );
 		VM_JSON_FIELD( vm::json::Any, params ) = vm::json::Any();
+		/* fixed for the lifetime of a session */
+		VM_JSON_FIELD( RealtimeRenderQuality, quality ) = RealtimeRenderQuality::Dynamic;
 	};
-
-	VM_ENUM( RealtimeRenderQuality,
-			 Lossless, Dynamic );
 }
 
 VM_END_MODULE()
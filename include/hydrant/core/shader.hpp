@@ -70,6 +70,9 @@ struct ViewArgs
 struct ImageDesc
 {
 	ivec2 resolution;
+	/* passes only visit pixels [ origin, origin + extent ) */
+	ivec2 origin;
+	ivec2 extent;
 	size_t pixel_size;
 	char *data;
 
@@ -77,9 +80,23 @@ struct ImageDesc
 	void create_from_img( cufx::ImageView<P> const &img, bool device )
 	{
 		resolution = ivec2{ img.width(), img.height() };
+		origin = ivec2{ 0, 0 };
+		extent = resolution;
 		pixel_size = sizeof( P );
 		data = reinterpret_cast<char *>( device ? &img.at_device( 0, 0 ) : &img.at_host( 0, 0 ) );
 	}
+
+	void crop( ivec2 const &min, ivec2 const &max )
+	{
+		origin = clamp( min, ivec2( 0 ), resolution );
+		extent = clamp( max, origin, resolution ) - origin;
+	}
+
+	__host__ __device__ char *
+	  at( int x, int y ) const
+	{
+		return data + pixel_size * ( resolution.x * ( origin.y + y ) + origin.x + x );
+	}
 };
 
 using function_ptr_t = void ( * )();
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <VMUtils/timer.hpp>
 #include <varch/thumbnail.hpp>
 #include <hydrant/dyn_kd_tree.hpp>
+#include <hydrant/block_cost.hpp>
 #include <hydrant/basic_renderer.hpp>
+#include <hydrant/compositing.hpp>
 #include <hydrant/double_buffering.hpp>
+#include <hydrant/frame_sync.hpp>
+#include <hydrant/tile_scheduler.hpp>
 #include <hydrant/octree_culler.hpp>
+#include <hydrant/value_range.hpp>
+#include <hydrant/paging/brick_migration.hpp>
+#include <hydrant/paging/lossless_block_paging.hpp>
 
 VM_BEGIN_MODULE( hydrant )
 
@@ -12,20 +20,52 @@ VM_EXPORT
 {
 	struct DbufRtRenderCtx : vm::Dynamic
 	{
+		virtual RtBlockPagingServer *paging_server() { return nullptr; }
 	};
 	
 	template <typename Shader>
 	struct DbufRenderer : BasicRenderer<Shader>
 	{
+		void update( vm::json::Any const &params_in ) override
+		{
+			BasicRenderer<Shader>::update( params_in );
+
+			auto params = params_in.get<BasicRendererParams>();
+			compositing.set_radix( params.compositing_radix )
+			  .set_streaming( params.streaming_compositing )
+			  .set_hierarchical( params.hierarchical_compositing );
+			kd_balance.set_move_cost( params.kd_move_cost );
+			migration_cache_mb = params.migration_cache_mb;
+			distribution = params.distribution;
+			tile_size = params.tile_size;
+		}
+
 		void realtime_render_dynamic( IRenderLoop &loop, MpiComm const &comm )
 		{			
 			std::unique_ptr<DbufRtRenderCtx> ctx( create_dbuf_rt_render_ctx() );
 			OctreeCuller culler( this->exhibit, this->chebyshev_thumb );
+			auto srv = ctx->paging_server();
+			std::unique_ptr<BrickMigration> migration;
+			/* the distribution is fixed for the whole loop, updates apply to the next */
+			auto sort_first = distribution == Distribution::SortFirst;
+			tiles.reset();
+			if ( sort_first ) {
+				tiles.reset( new TileScheduler( comm, this->resolution, tile_size ) );
+			} else if ( srv && migration_cache_mb > 0 && comm.size > 1 ) {
+				migration.reset( new BrickMigration( comm, *srv ) );
+			}
 
-			std::vector<std::size_t> render_t( comm.size );
-			std::vector<std::pair<int, int>> dist( comm.size );
-			std::vector<int> z_order( comm.size );
+			std::size_t last_render_t = 0;
+			FrameSync sync( comm );
 			DynKdTree kd_tree( this->dim, comm.size );
+			BlockCostModel cost_model( this->dim, comm.size );
+			auto aspect = float( this->resolution.x ) / this->resolution.y;
+			auto occupied = [&]( uvec3 const &idx ) {
+				if ( this->skip_field ) {
+					return ( *this->skip_field )[ idx ] == 0;
+				}
+				return ( *chebyshev_thumb )[ vol::Idx{}.set_x( idx.x ).set_y( idx.y ).set_z( idx.z ) ] == 0;
+			};
 				
 			FnDoubleBuffering loop_drv(
 			  ImageOptions{}
@@ -35,28 +75,29 @@ VM_EXPORT
 			  [&]( auto &frame, auto frame_idx ) {
 				  auto orig = culler.get_orig( loop.camera );
 				  // vm::println("orig = {}", orig);
-				  auto bbox = kd_tree.search( comm.rank, orig, dist[ comm.rank ].first );
+				  /* sort-first ranks all render the whole volume */
+				  int dist = 0;
+				  auto bbox = sort_first ? BoundingBox{}.set_min( ivec3( 0 ) ).set_max( ivec3( this->dim ) )
+										 : kd_tree.search( comm.rank, orig, dist );
+				  sync.post( FrameRecord{ dist, srv ? srv->pending_blocks() : 0,
+										  last_render_t, loop.camera } );
+				  if ( migration ) { migration->poll(); }
 				  culler.set_bbox( bbox );
+				  culler.set_skip_field( this->skip_field );
+				  culler.set_priority( this->block_priority );
+				  viewport = to_viewport( culler.project( loop.camera ) );
 				  this->shader.bbox = Box3D{ bbox.min, bbox.max };
-				  for ( int i = 0; i < comm.size; ++i ) {
-					  MPI_Bcast( &dist[ i ].first, sizeof( int ), MPI_CHAR, i, comm.comm );
-					  dist[ i ].second = i;
-				  }
-				  MPI_Barrier( comm.comm );
-				  std::sort( dist.begin(), dist.end(),
-							 []( auto &x, auto &y ) { return x.first < y.first; } );
-				  std::transform( dist.begin(), dist.end(), z_order.begin(),
-								  []( auto &x ) { return x.second; } );
-
-				  render_t[ comm.rank ] = dbuf_rt_render_frame( frame, *ctx,
-																loop, culler, comm,
-																z_order );
-				  for ( int i = 0; i < comm.size; ++i ) {
-					  MPI_Bcast( &render_t[ i ], sizeof( std::size_t ), MPI_CHAR, i, comm.comm );
+
+				  last_render_t = dbuf_rt_render_frame( frame, *ctx,
+														loop, culler, comm,
+														sync );
+				  /* every rank holds the same records, so all place the same splits */
+				  if ( comm.size > 1 && !sort_first ) {
+					  auto before = kd_tree.regions();
+					  cost_model.rebalance( kd_tree, this->exhibit.get_iet(), sync.get(),
+											aspect, occupied, kd_balance );
+					  if ( migration ) { migration->migrate( before, kd_tree.regions() ); }
 				  }
-				  MPI_Barrier( comm.comm );
-				  
-				  kd_tree.update( render_t );
 			  },
 			  [&]( auto &frame, auto frame_idx ) {
 				  auto fp = frame.fetch_data();
@@ -64,6 +105,249 @@ VM_EXPORT
 			  });
 
 			loop_drv.run();
+			tiles.reset();
+		}
+
+		/* each rank pages its kd subdomain in lossless batches and the local
+		   images are composited as in dynamic frames. renderers without a
+		   lossless context keep the single rank path */
+		void realtime_render_lossless( IRenderLoop &loop, MpiComm const &comm ) override
+		{
+			std::unique_ptr<DbufRtRenderCtx> ctx;
+			if ( comm.size > 1 ) { ctx.reset( create_dbuf_lossless_ctx() ); }
+			if ( !ctx ) {
+				BasicRenderer<Shader>::realtime_render_lossless( loop, comm );
+				return;
+			}
+			OctreeCuller culler( this->exhibit, this->chebyshev_thumb );
+			auto full_bbox = this->shader.bbox;
+
+			std::size_t last_render_t = 0;
+			FrameSync sync( comm );
+			DynKdTree kd_tree( this->dim, comm.size );
+			BlockCostModel cost_model( this->dim, comm.size );
+			auto aspect = float( this->resolution.x ) / this->resolution.y;
+			auto occupied = [&]( uvec3 const &idx ) {
+				if ( this->skip_field ) {
+					return ( *this->skip_field )[ idx ] == 0;
+				}
+				return ( *chebyshev_thumb )[ vol::Idx{}.set_x( idx.x ).set_y( idx.y ).set_z( idx.z ) ] == 0;
+			};
+
+			FnDoubleBuffering loop_drv(
+			  ImageOptions{}
+				.set_device( this->device )
+				.set_resolution( this->resolution ),
+			  loop,
+			  [&]( auto &frame, auto frame_idx ) {
+				  int dist;
+				  auto bbox = kd_tree.search( comm.rank, culler.get_orig( loop.camera ), dist );
+				  sync.post( FrameRecord{ dist, 0, last_render_t, loop.camera } );
+				  culler.set_bbox( bbox );
+				  culler.set_skip_field( this->skip_field );
+				  viewport = to_viewport( culler.project( loop.camera ) );
+				  this->shader.bbox = Box3D{ bbox.min, bbox.max };
+
+				  last_render_t = dbuf_lossless_render_frame( frame, *ctx,
+															  loop, culler, comm,
+															  sync );
+				  cost_model.rebalance( kd_tree, this->exhibit.get_iet(), sync.get(),
+										aspect, occupied, kd_balance );
+			  },
+			  [&]( auto &frame, auto frame_idx ) {
+				  auto fp = frame.fetch_data();
+				  loop.on_frame( fp );
+			  } );
+
+			loop_drv.run();
+			this->shader.bbox = full_bbox;
+		}
+
+	protected:
+		/* pixels covered by a camera plane rect, with a one pixel margin */
+		Viewport to_viewport( ScreenRect const &rect ) const
+		{
+			auto res = vec2( this->resolution );
+			auto to_px = [&]( vec2 const &p ) { return vec2( p.x, -p.y ) * res.y / 2.f + res / 2.f; };
+			auto a = to_px( rect.min );
+			auto b = to_px( rect.max );
+			auto lo = clamp( floor( min( a, b ) ) - 1.f, vec2( 0 ), res );
+			auto hi = clamp( ceil( max( a, b ) ) + 1.f, vec2( 0 ), res );
+			return Viewport{}.set_min( ivec2( lo ) ).set_max( ivec2( hi ) );
+		}
+
+		/* renders the first round compositing pieces one at a time, each is
+		   fetched into its own band image and handed to the compositor so its
+		   exchange overlaps the rendering of the rest. returns the render time */
+		template <typename Film, typename P, typename Blend, typename Convert>
+		std::size_t stream_render_frame( Image<cufx::StdByte3Pixel> &frame,
+										 Image<Film> &film, Image<P> &local,
+										 std::vector<Image<P>> &bands,
+										 SortLastCompositor<P> &compositor,
+										 IRenderLoop &loop, MpiComm const &comm,
+										 FrameSync &sync,
+										 Blend const &blend, Convert const &convert )
+		{
+			auto &z_order = sync.z_order();
+			auto &pieces = compositor.stream_begin( this->resolution.x, this->resolution.y,
+													comm, z_order, compositing );
+			/* pieces differ by at most a row, bands fit the largest */
+			auto n = int( pieces.size() );
+			auto band_res = ivec2( this->resolution.x, ( this->resolution.y + n - 1 ) / n );
+			if ( bands.size() != n || bands[ 0 ].view().width() != band_res.x ||
+				 bands[ 0 ].view().height() != band_res.y ) {
+				bands.clear();
+				for ( int i = 0; i != n; ++i ) {
+					bands.emplace_back( ImageOptions{}
+										  .set_device( this->device )
+										  .set_resolution( band_res ) );
+				}
+			}
+			auto local_view = local.view();
+			std::size_t render_t = 0;
+			for ( int i = 0; i != pieces.size(); ++i ) {
+				auto &piece = pieces[ i ];
+				auto bytes = this->resolution.x * piece.rows() * sizeof( P );
+				auto dst = &local_view.at_host( 0, piece.y0 );
+				auto vp = Viewport{}
+							.set_min( ivec2( viewport.min.x, std::max( viewport.min.y, piece.y0 ) ) )
+							.set_max( ivec2( viewport.max.x, std::min( viewport.max.y, piece.y1 ) ) );
+				if ( vp.min.x >= vp.max.x || vp.min.y >= vp.max.y ) {
+					memset( dst, 0, bytes );
+				} else {
+					vm::Timer::Scoped timer( [&]( auto dt ) { render_t += dt.ns().cnt(); } );
+					auto &band = bands[ i ];
+					auto opts = RaycastingOptions{}
+								  .set_device( this->device )
+								  .set_viewport( vp )
+								  .set_dst_offset( ivec2( 0, piece.y0 ) );
+					this->raycaster.ray_emit_pass( this->exhibit, loop.camera,
+												   film.view(), this->shader, opts );
+					this->raycaster.fetch_pass( film.view(), band.view(), this->shader, opts );
+					band.update_device_view();
+					band.fetch_data();
+					clear_outside( band.view(),
+								   Viewport{}
+									 .set_min( vp.min - ivec2( 0, piece.y0 ) )
+									 .set_max( vp.max - ivec2( 0, piece.y0 ) ) );
+					memcpy( dst, &band.view().at_host( 0, 0 ), bytes );
+				}
+				compositor.stream_piece( local_view, comm, i, blend );
+			}
+			auto frame_view = frame.view();
+			compositor.stream_end( local_view, frame_view, comm, z_order, blend, convert );
+			return render_t;
+		}
+
+		/* marches the lossless batches of the culled blocks, then fetches and
+		   composites the local image. returns the render time */
+		template <typename Film, typename P, typename Blend, typename Convert>
+		std::size_t lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+										   LosslessBlockPagingServer &srv, mat4 const &et,
+										   Image<Film> &film, Image<P> &local,
+										   SortLastCompositor<P> &compositor,
+										   IRenderLoop &loop, OctreeCuller &culler,
+										   MpiComm const &comm, FrameSync &sync,
+										   Blend const &blend, Convert const &convert )
+		{
+			std::size_t render_t;
+			bool emit = true;
+			{
+				vm::Timer::Scoped timer( [&]( auto dt ) { render_t = dt.ns().cnt(); } );
+				auto opts = RaycastingOptions{}
+							  .set_device( this->device )
+							  .set_viewport( viewport );
+				auto state = srv.start( culler, loop.camera, et );
+				while ( state.next( this->shader.paging ) ) {
+					if ( emit ) {
+						this->raycaster.ray_emit_pass( this->exhibit, loop.camera,
+													   film.view(), this->shader, opts );
+						emit = false;
+					} else {
+						this->raycaster.ray_march_pass( film.view(), this->shader, opts );
+					}
+				}
+				if ( !emit ) {
+					this->raycaster.fetch_pass( film.view(), local.view(), this->shader, opts );
+					local.update_device_view();
+				}
+			}
+
+			auto local_view = local.view();
+			if ( emit ) {
+				/* no block of this subdomain is visible */
+				memset( &local_view.at_host( 0, 0 ), 0, local.bytes() );
+			} else {
+				local.fetch_data();
+				clear_outside( local_view, viewport );
+			}
+			auto frame_view = frame.view();
+			auto &z_order = sync.z_order();
+			compositor.composite( local_view, frame_view, comm, z_order, compositing,
+								  blend, convert );
+			return render_t;
+		}
+
+		/* renders the screen tiles this rank takes from the scheduler, each is
+		   fetched into a tile sized band, converted and sent to the leader.
+		   returns the render time */
+		template <typename Film, typename P, typename Convert>
+		std::size_t tile_render_frame( Image<cufx::StdByte3Pixel> &frame,
+									   Image<Film> &film, std::vector<Image<P>> &bands,
+									   IRenderLoop &loop, Convert const &convert )
+		{
+			auto size = tiles->size();
+			if ( bands.size() != 1 || bands[ 0 ].view().width() != size ||
+				 bands[ 0 ].view().height() != size ) {
+				bands.clear();
+				bands.emplace_back( ImageOptions{}
+									  .set_device( this->device )
+									  .set_resolution( ivec2( size ) ) );
+			}
+			auto &band = bands[ 0 ];
+			auto frame_view = frame.view();
+			auto empty = convert( P{} );
+			std::vector<cufx::StdByte3Pixel> rgb( size * size );
+			std::size_t render_t = 0;
+
+			tiles->begin_frame();
+			for ( int i; ( i = tiles->next() ) >= 0; ) {
+				auto tile = tiles->tile( i );
+				auto w = tile.max.x - tile.min.x;
+				auto h = tile.max.y - tile.min.y;
+				auto vp = Viewport{}
+							.set_min( max( viewport.min, tile.min ) )
+							.set_max( min( viewport.max, tile.max ) );
+				if ( vp.min.x >= vp.max.x || vp.min.y >= vp.max.y ) {
+					std::fill( rgb.begin(), rgb.begin() + w * h, empty );
+				} else {
+					{
+						vm::Timer::Scoped timer( [&]( auto dt ) { render_t += dt.ns().cnt(); } );
+						auto opts = RaycastingOptions{}
+									  .set_device( this->device )
+									  .set_viewport( vp )
+									  .set_dst_offset( tile.min );
+						this->raycaster.ray_emit_pass( this->exhibit, loop.camera,
+													   film.view(), this->shader, opts );
+						this->raycaster.fetch_pass( film.view(), band.view(), this->shader, opts );
+						band.update_device_view();
+						band.fetch_data();
+						clear_outside( band.view(),
+									   Viewport{}
+										 .set_min( vp.min - tile.min )
+										 .set_max( vp.max - tile.min ) );
+					}
+					auto band_view = band.view();
+					for ( int y = 0; y != h; ++y ) {
+						for ( int x = 0; x != w; ++x ) {
+							rgb[ y * w + x ] = convert( band_view.at_host( x, y ) );
+						}
+					}
+				}
+				tiles->submit( i, rgb.data(), frame_view );
+			}
+			tiles->end_frame( frame_view );
+			return render_t;
 		}
 
 	public:
@@ -77,10 +361,39 @@ VM_EXPORT
 										   IRenderLoop &loop,
 										   OctreeCuller &culler,
 										   MpiComm const &comm,
-										   std::vector<int> const &z_order ) = 0;
+										   FrameSync &sync ) = 0;
+
+		virtual DbufRtRenderCtx *create_dbuf_lossless_ctx()
+		{
+			return nullptr;
+		}
+
+		virtual std::size_t dbuf_lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+														DbufRtRenderCtx &ctx,
+														IRenderLoop &loop,
+														OctreeCuller &culler,
+														MpiComm const &comm,
+														FrameSync &sync )
+		{
+			return 0;
+		}
 
 	protected:
 		std::shared_ptr<vol::Thumbnail<int>> chebyshev_thumb;
+		std::shared_ptr<ValueRangeThumbnail> value_range;
+		/* chebyshev field of blocks that contribute under current params */
+		std::shared_ptr<ChebyshevField> skip_field;
+		/* decode and eviction order of the realtime paging server, distance if unset */
+		std::shared_ptr<IBlockPriority> block_priority;
+		CompositingOptions compositing;
+		KdBalanceOptions kd_balance;
+		std::size_t migration_cache_mb = 0;
+		Distribution distribution = Distribution::SortLast;
+		int tile_size = 64;
+		/* shared tile counter, only set inside a sort-first render loop */
+		std::unique_ptr<TileScheduler> tiles;
+		/* screen footprint of this rank's subdomain in the current frame */
+		Viewport viewport;
 	};
 }
 
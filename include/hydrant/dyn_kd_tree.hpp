@@ -1,90 +1,66 @@
 #pragma once
 
 #include <VMUtils/concepts.hpp>
+#include <VMUtils/attributes.hpp>
 #include <hydrant/octree_culler.hpp>
 
 VM_BEGIN_MODULE( hydrant )
 
-#define SAMPLE_PTS 20
-
 VM_EXPORT
 {
-	struct Ratio
-	{
-		Ratio() :
-			val( SAMPLE_PTS, 0.5 ),
-			idx( 0 ),
-			num( SAMPLE_PTS )
-		{
-			for ( auto &x: val ) { sum += x; }
-		}
-
-		void update( float v )
-		{
-			sum -= val[ idx ];
-			sum += val[ idx ] = v;
-			idx = ( idx + 1 ) % num;
-		}
-
-		float value() const
-		{
-			return sum / num;
-		}
-
-	private:
-		std::vector<float> val;
-		int idx, num;
-		float sum = 0;
-	};
-	
 	struct KdNode
 	{
 		std::unique_ptr<KdNode> left, right;
 		int rank, axis, mid;
-		Ratio ratio;
-
-	public:
-		void update_by_ratio( BoundingBox const &parent,
-							  BoundingBox &left,
-							  BoundingBox &right )
-		{
-			left = right = parent;
-			vec3 minp = parent.min;
-			vec3 maxp = parent.max;
-			vec3 midp_f = minp * ( 1 - ratio.value() ) + maxp * ratio.value();
-			ivec3 midp = round( midp_f );
-			int mid1;
-			switch ( axis ) {
-			case 0: mid1 = left.max.x = right.min.x = midp.x; break;
-			case 1: mid1 = left.max.y = right.min.z = midp.y; break;
-			case 2: mid1 = left.max.z = right.min.z = midp.z; break;
-			}
-			if ( abs( mid1 - mid ) > 1 ) {
-				mid = mid1;
-			}
-		}
 	};
 
-	struct RangeSum
+	/* 3d prefix sums over a block grid, sums boxes in constant time */
+	struct BoxSum
 	{
-		RangeSum( std::vector<std::size_t> const &vals ) :
-			sums( vals.size() + 1 )
+		template <typename F>
+		void build( ivec3 const &dim, F const &f )
 		{
-			std::size_t sum = 0;
-			for ( int i = 0; i != vals.size(); ++i ) {
-				sums[ i ] = sum;
-				sum += vals[ i ];
+			d = dim + 1;
+			sums.assign( d.x * d.y * d.z, 0. );
+			for ( int z = 1; z < d.z; ++z ) {
+				for ( int y = 1; y < d.y; ++y ) {
+					for ( int x = 1; x < d.x; ++x ) {
+						at( x, y, z ) = f( uvec3( x - 1, y - 1, z - 1 ) ) +
+										at( x - 1, y, z ) + at( x, y - 1, z ) + at( x, y, z - 1 ) -
+										at( x - 1, y - 1, z ) - at( x - 1, y, z - 1 ) - at( x, y - 1, z - 1 ) +
+										at( x - 1, y - 1, z - 1 );
+					}
+				}
 			}
-			sums[ vals.size() ] = sum;
 		}
 
-		std::size_t range_sum( int low, int high ) const
+		double sum( BoundingBox const &box ) const
 		{
-			return sums[ high ] - sums[ low ];
+			auto &a = box.min;
+			auto &b = box.max;
+			if ( a.x >= b.x || a.y >= b.y || a.z >= b.z ) return 0.;
+			return at( b.x, b.y, b.z ) -
+				   at( a.x, b.y, b.z ) - at( b.x, a.y, b.z ) - at( b.x, b.y, a.z ) +
+				   at( a.x, a.y, b.z ) + at( a.x, b.y, a.z ) + at( b.x, a.y, a.z ) -
+				   at( a.x, a.y, a.z );
 		}
-		
+
+	private:
+		double &at( int x, int y, int z ) { return sums[ x + d.x * ( y + d.y * z ) ]; }
+
+		double at( int x, int y, int z ) const { return sums[ x + d.x * ( y + d.y * z ) ]; }
+
 	private:
-		std::vector<std::size_t> sums;
+		ivec3 d;
+		std::vector<double> sums;
+	};
+
+	struct KdBalanceOptions
+	{
+		/* relative load gains below this are treated as noise */
+		VM_DEFINE_ATTRIBUTE( float, min_gain ) = .02f;
+		/* extra gain a split move needs per rank's worth of bricks changing owner */
+		VM_DEFINE_ATTRIBUTE( float, move_cost ) = .2f;
 	};
 	
 	struct DynKdTree
@@ -105,32 +81,83 @@ VM_EXPORT
 			return res;
 		}
 
-		void update( std::vector<std::size_t> const &render_t )
+		/* regions of all ranks */
+		std::vector<BoundingBox> regions() const
 		{
-			RangeSum sum( render_t );
-			update_impl( root.get(), sum, bbox, 0, cnt );
+			std::vector<BoundingBox> res( cnt );
+			for ( int i = 0; i != cnt; ++i ) {
+				int dist;
+				res[ i ] = search( i, vec3( 0 ), dist );
+			}
+			return res;
+		}
+
+		/* places each split where both sides carry work in proportion to their
+		   rank count, a split only moves if the load gain pays for paging the
+		   bricks that change owner */
+		void balance( BoxSum const &work, BoxSum const &bricks,
+					  KdBalanceOptions const &opts = KdBalanceOptions{} )
+		{
+			balance_impl( root.get(), work, bricks, opts, bbox, 0, cnt );
 		}
 
 	private:
-		void update_impl( KdNode *node, RangeSum const &sum,
-						  BoundingBox const &bbox, int low, int high )
+		void balance_impl( KdNode *node, BoxSum const &work, BoxSum const &bricks,
+						   KdBalanceOptions const &opts,
+						   BoundingBox const &bbox, int low, int high )
 		{
 			if ( node == nullptr ) return;
-			
-			auto l_t = sum.range_sum( low, node->rank );
-			auto r_t = sum.range_sum( node->rank, high );
-
-			const float speed = 0.1;
-			double l = node->ratio.value() * double( r_t );
-			double r = ( 1 - node->ratio.value() ) * double( l_t );
-			node->ratio.update( speed * l / ( l + r ) + ( 1 - speed ) * node->ratio.value() );
+
+			auto axis = node->axis;
+			auto lo = bbox.min[ axis ];
+			auto hi = bbox.max[ axis ];
+			auto nl = double( node->rank - low );
+			auto nr = double( high - node->rank );
+			auto halves = [&]( int m, BoundingBox &l, BoundingBox &r ) {
+				l = r = bbox;
+				l.max[ axis ] = r.min[ axis ] = m;
+			};
+			auto load = [&]( int m ) {
+				BoundingBox l, r;
+				halves( m, l, r );
+				return std::max( work.sum( l ) / nl, work.sum( r ) / nr );
+			};
+
+			/* the first plane where the left side takes its share, or the one before */
+			int m0 = lo, m1 = hi;
+			while ( m0 < m1 ) {
+				auto m = ( m0 + m1 ) / 2;
+				BoundingBox l, r;
+				halves( m, l, r );
+				if ( work.sum( l ) * nr >= work.sum( r ) * nl ) {
+					m1 = m;
+				} else {
+					m0 = m + 1;
+				}
+			}
+			auto best = m0 > lo && load( m0 - 1 ) < load( m0 ) ? m0 - 1 : m0;
+
+			auto mid = std::min( std::max( node->mid, lo ), hi );
+			auto curr = load( mid );
+			if ( best != mid && curr > 0. ) {
+				auto gain = ( curr - load( best ) ) / curr;
+				auto slab = bbox;
+				slab.min[ axis ] = std::min( mid, best );
+				slab.max[ axis ] = std::max( mid, best );
+				auto per_rank = bricks.sum( bbox ) / ( high - low );
+				auto moved = per_rank > 0. ? bricks.sum( slab ) / per_rank : 0.;
+				if ( gain > opts.min_gain + opts.move_cost * moved ) {
+					mid = best;
+				}
+			}
+			node->mid = mid;
+
 			BoundingBox bbox_l, bbox_r;
-			node->update_by_ratio( bbox, bbox_l, bbox_r );
-			
-			update_impl( node->left.get(), sum, bbox_l, low, node->rank );
-			update_impl( node->right.get(), sum, bbox_r, node->rank, high );
+			halves( mid, bbox_l, bbox_r );
+			balance_impl( node->left.get(), work, bricks, opts, bbox_l, low, node->rank );
+			balance_impl( node->right.get(), work, bricks, opts, bbox_r, node->rank, high );
 		}
-		
+
 		void search_impl( KdNode *node, int low, int high, int rank,
 						  BoundingBox &res, vec3 const &orig, int &dist ) const
 		{
@@ -179,10 +206,10 @@ VM_EXPORT
 				auto next_axis = ( axis + 1 ) % 3;
 				node->rank = rank;
 				node->axis = axis;
-				BoundingBox bbox_l, bbox_r;
-				node->update_by_ratio( bbox, bbox_l, bbox_r );
-				vm::println( "{} {} => {} {}, {} {}", bbox.min, bbox.max,
-							 bbox_l.min, bbox_l.max, bbox_r.min, bbox_r.max );
+				/* even halves until balance moves the plane */
+				node->mid = ( bbox.min[ axis ] + bbox.max[ axis ] + 1 ) / 2;
+				BoundingBox bbox_l = bbox, bbox_r = bbox;
+				bbox_l.max[ axis ] = bbox_r.min[ axis ] = node->mid;
 				node->left = split( bbox_l, low_rank, rank, next_axis );
 				node->right = split( bbox_r, rank, high_rank, next_axis );
 				res.reset( node );
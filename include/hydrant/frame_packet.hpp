@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <VMUtils/modules.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* leads every frame the leader sends. raw frames follow with width * height
+	   rgb pixels, jpeg frames with nstripes int32 sizes and then the stripes,
+	   each an image of its own that covers stripe_rows rows, the last one
+	   possibly fewer. h264 frames come as a single stripe of annex b nal
+	   units, empty when the encoder dropped the frame */
+	struct FramePacketHeader
+	{
+		int32_t format;
+		int32_t width, height;
+		int32_t nstripes;
+		int32_t stripe_rows;
+	};
+}
+
+VM_END_MODULE()
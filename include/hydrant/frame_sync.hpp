@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <mpi.h>
+#include <VMUtils/concepts.hpp>
+#include <hydrant/core/scene.hpp>
+#include <hydrant/mpi_utils.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* what a rank reports each frame, render time and paging stats are those
+	   of the previous frame */
+	struct FrameRecord
+	{
+		int dist;
+		int pending_blocks;
+		std::uint64_t render_t;
+		/* the leader's is the one every rank balances for */
+		Camera camera;
+	};
+
+	/* exchanges frame records with one non-blocking allgather per frame. the
+	   gather runs while the frame culls and renders and is only waited for
+	   when the depth order is needed, so frames need no barrier */
+	struct FrameSync : vm::NoCopy, vm::NoMove
+	{
+		FrameSync( MpiComm const &comm ) :
+		  comm( comm ),
+		  records( comm.size ),
+		  z( comm.size )
+		{
+		}
+
+		~FrameSync()
+		{
+			wait();
+		}
+
+	public:
+		void post( FrameRecord const &rec )
+		{
+			wait();
+			mine = rec;
+			MPI_Iallgather( &mine, sizeof( FrameRecord ), MPI_CHAR,
+							records.data(), sizeof( FrameRecord ), MPI_CHAR,
+							comm.comm, &req );
+			ordered = false;
+		}
+
+		/* ranks front to back, ties broken by rank so every rank agrees */
+		std::vector<int> const &z_order()
+		{
+			if ( !ordered ) {
+				wait();
+				std::iota( z.begin(), z.end(), 0 );
+				std::sort( z.begin(), z.end(), [&]( int a, int b ) {
+					return records[ a ].dist != records[ b ].dist ? records[ a ].dist < records[ b ].dist : a < b;
+				} );
+				ordered = true;
+			}
+			return z;
+		}
+
+		std::vector<FrameRecord> const &get()
+		{
+			wait();
+			return records;
+		}
+
+	private:
+		void wait()
+		{
+			if ( req != MPI_REQUEST_NULL ) {
+				MPI_Wait( &req, MPI_STATUS_IGNORE );
+			}
+		}
+
+	private:
+		MpiComm comm;
+		FrameRecord mine;
+		std::vector<FrameRecord> records;
+		std::vector<int> z;
+		MPI_Request req = MPI_REQUEST_NULL;
+		bool ordered = false;
+	};
+}
+
+VM_END_MODULE()
@@ -6,6 +6,8 @@
 #include <varch/thumbnail.hpp>
 #include <hydrant/core/glm_math.hpp>
 #include <hydrant/core/scene.hpp>
+#include <hydrant/value_range.hpp>
+#include <hydrant/paging/block_priority.hpp>
 
 VM_BEGIN_MODULE( hydrant )
 
@@ -116,8 +118,24 @@ VM_EXPORT
 				LOG( FATAL ) << vm::fmt( "invalid bbox = {}; with dim ={}",
 										 std::make_pair( bbox.min, bbox.max ), dim );
 			}
+			return *this;
 		}
 
+		/* overrides the raw data chebyshev thumbnail when culling empty blocks */
+		OctreeCuller &set_skip_field( std::shared_ptr<ChebyshevField> const &skip_field )
+		{
+			this->skip_field = skip_field;
+			return *this;
+		}
+
+		/* ranks blocks by priority instead of distance to the camera */
+		OctreeCuller &set_priority( std::shared_ptr<IBlockPriority> const &priority )
+		{
+			this->priority = priority;
+			return *this;
+		}
+
+		/* dist_fn receives the ranking key, lower keys come first */
 		const std::vector<vol::Idx> &cull( Camera const &camera,
 										   std::function<float( vol::Idx const & )> *dist_fn = nullptr,
 										   std::size_t limit = std::numeric_limits<std::size_t>::max(),
@@ -133,7 +151,7 @@ VM_EXPORT
 			for ( idx.z = bbox.min.z; idx.z != bbox.max.z; ++idx.z ) {
 				for ( idx.y = bbox.min.y; idx.y != bbox.max.y; ++idx.y ) {
 					for ( idx.x = bbox.min.x; idx.x != bbox.max.x; ++idx.x ) {
-						if ( ( *chebyshev_thumb )[ idx ] == 0 ) {
+						if ( is_occupied( idx ) ) {
 							auto x = vec3( idx.x, idx.y, idx.z );
 							// bool strict;
 							if ( frust.contains_fast( BoundingBox{ x, x + 1.f } ) ) {
@@ -143,10 +161,15 @@ VM_EXPORT
 					}
 				}
 			}
-			auto df = [orig=frust.orig]( vol::Idx const &idx ) {
-				return distance2( orig,
-								  vec3( idx.x, idx.y, idx.z ) + .5f );
-			};
+			std::function<float( vol::Idx const & )> df =
+			  [orig=frust.orig]( vol::Idx const &idx ) {
+				  return distance2( orig,
+									vec3( idx.x, idx.y, idx.z ) + .5f );
+			  };
+			if ( priority ) {
+				priority->update( camera, inverse( itrans ) );
+				df = [p = priority]( vol::Idx const &idx ) { return -p->priority( idx ); };
+			}
 			if ( dist_fn ) { *dist_fn = df; }
 			auto length = std::min( limit, buf.size() );
 			std::nth_element(
@@ -160,6 +183,29 @@ VM_EXPORT
 			return buf;
 		}
 
+		/* camera plane rect that bounds the projection of the current bbox,
+		   the whole screen if the bbox reaches behind the eye */
+		ScreenRect project( Camera const &camera ) const
+		{
+			auto full = ScreenRect{}
+						  .set_min( vec2( -INFINITY ) )
+						  .set_max( vec2( INFINITY ) );
+			if ( isinf( camera.ctg_fovy_2 ) ) return full;
+			auto trans = inverse( exhibit.get_iet() * camera.get_ivt() );
+			auto rect = ScreenRect{}
+						  .set_min( vec2( INFINITY ) )
+						  .set_max( vec2( -INFINITY ) );
+			vec3 const vp[ 2 ] = { bbox.min, bbox.max };
+			for ( int i = 0; i != 8; ++i ) {
+				vec3 c = trans * vec4( vp[ i & 1 ].x, vp[ i >> 1 & 1 ].y, vp[ i >> 2 & 1 ].z, 1 );
+				if ( c.z > -1e-3f ) return full;
+				auto p = vec2( c ) * camera.ctg_fovy_2 / -c.z;
+				rect.min = min( rect.min, p );
+				rect.max = max( rect.max, p );
+			}
+			return rect;
+		}
+
 		vec3 get_orig( Camera camera ) const
 		{
 			auto itrans = exhibit.get_iet() * camera.get_ivt();
@@ -167,6 +213,14 @@ VM_EXPORT
 		}
 
 	private:
+		bool is_occupied( vol::Idx const &idx ) const
+		{
+			if ( skip_field ) {
+				return ( *skip_field )[ uvec3( idx.x, idx.y, idx.z ) ] == 0;
+			}
+			return ( *chebyshev_thumb )[ idx ] == 0;
+		}
+
 		inline static unsigned log_2_up( unsigned x )
 		{
 			unsigned v = 0;
@@ -213,6 +267,8 @@ VM_EXPORT
 	private:
 		Exhibit exhibit;
 		std::shared_ptr<vol::Thumbnail<int>> chebyshev_thumb;
+		std::shared_ptr<ChebyshevField> skip_field;
+		std::shared_ptr<IBlockPriority> priority;
 		ivec3 dim, log_dim_up, dim_up;
 		BoundingBox bbox;
 		std::vector<vol::Idx> buf;
@@ -6,8 +6,73 @@
 
 VM_BEGIN_MODULE( hydrant )
 
+/* macro cells per block edge */
+#define MACRO_CELL_DIM ( 8 )
+#define MACRO_CELL_COUNT ( MACRO_CELL_DIM * MACRO_CELL_DIM * MACRO_CELL_DIM )
+
 VM_EXPORT
 {
+	/* value range of a macro cell, including the voxels read by trilinear filtering */
+	struct MacroCell
+	{
+		unsigned char min, max;
+	};
+
+	/* computes MACRO_CELL_COUNT cells of a decoded padded block */
+	inline void compute_macro_cells( unsigned char const *block,
+									 int block_size, int padding,
+									 MacroCell *cells )
+	{
+		auto pad_bs = block_size + 2 * padding;
+		auto cs = float( block_size ) / MACRO_CELL_DIM;
+		ivec3 c;
+		for ( c.z = 0; c.z != MACRO_CELL_DIM; ++c.z ) {
+			for ( c.y = 0; c.y != MACRO_CELL_DIM; ++c.y ) {
+				for ( c.x = 0; c.x != MACRO_CELL_DIM; ++c.x ) {
+					auto lo = max( ivec3( floor( vec3( c ) * cs ) ) + padding - 1, ivec3( 0 ) );
+					auto hi = min( ivec3( ceil( vec3( c + 1 ) * cs ) ) + padding + 1, ivec3( pad_bs ) );
+					MacroCell cell = { 255, 0 };
+					ivec3 x;
+					for ( x.z = lo.z; x.z < hi.z; ++x.z ) {
+						for ( x.y = lo.y; x.y < hi.y; ++x.y ) {
+							auto row = block + ( x.z * pad_bs + x.y ) * pad_bs;
+							for ( x.x = lo.x; x.x < hi.x; ++x.x ) {
+								cell.min = min( cell.min, row[ x.x ] );
+								cell.max = max( cell.max, row[ x.x ] );
+							}
+						}
+					}
+					cells[ ( c.z * MACRO_CELL_DIM + c.y ) * MACRO_CELL_DIM + c.x ] = cell;
+				}
+			}
+		}
+	}
+
+	/* returns the value of a block whose voxels are all equal, -1 otherwise */
+	inline int find_uniform_value( unsigned char const *block, std::size_t len )
+	{
+		for ( std::size_t i = 1; i < len; ++i ) {
+			if ( block[ i ] != block[ 0 ] ) return -1;
+		}
+		return block[ 0 ];
+	}
+
+	/* page table entries below -1 hold uniform blocks without a brick */
+	__host__ __device__ inline int uniform_vaddr( int value ) { return -2 - value; }
+
+	__host__ __device__ inline bool is_uniform_vaddr( int vaddr ) { return vaddr < -1; }
+
+	__host__ __device__ inline float uniform_vaddr_value( int vaddr ) { return ( -2 - vaddr ) / 255.f; }
+
+	/* number of march steps from ray.o that stay inside box, at least one */
+	__host__ __device__ inline int
+	  box_exit_steps( Ray const &ray, Box3D const &box, float step )
+	{
+		float tnear, tfar;
+		ray.intersect( box, tnear, tfar );
+		return (int)max( ceil( tfar / step ), 1.f );
+	}
+
 	struct BlockSamplerMapping
 	{
 		__host__ __device__ vec3
@@ -30,6 +95,16 @@ VM_EXPORT
 			return sampler.sample_3d<T>( mapping.mapped( x ) );
 		}
 
+		/* gradient is with respect to the block local coordinate, dt likewise */
+		template <typename T>
+		__host__ __device__ T
+		  sample_3d_grad( vec3 const &x, vec3 &grad, float dt, bool smooth = false ) const
+		{
+			auto val = sampler.sample_3d_grad<T>( mapping.mapped( x ), grad, dt * mapping.k, smooth );
+			grad *= mapping.k;
+			return val;
+		}
+
 	public:
 		VM_DEFINE_ATTRIBUTE( Sampler, sampler );
 		VM_DEFINE_ATTRIBUTE( BlockSamplerMapping, mapping );
@@ -37,10 +112,24 @@ VM_EXPORT
 
 	struct BlockPaging
 	{
+		/* x is the block local coordinate in [ 0, 1 ) */
+		__host__ __device__ MacroCell
+		  macro_cell( int pgid, vec3 const &x, Box3D &cell_box ) const
+		{
+			auto c = clamp( ivec3( x * float( MACRO_CELL_DIM ) ),
+							ivec3( 0 ), ivec3( MACRO_CELL_DIM - 1 ) );
+			cell_box.min = vec3( c ) / float( MACRO_CELL_DIM );
+			cell_box.max = cell_box.min + 1.f / MACRO_CELL_DIM;
+			return macro_cells[ pgid * MACRO_CELL_COUNT +
+								( c.z * MACRO_CELL_DIM + c.y ) * MACRO_CELL_DIM + c.x ];
+		}
+
 	public:
 		Sampler vaddr;
 		int lowest_blkcnt;
 		BlockSampler const *block_sampler;
+		/* MACRO_CELL_COUNT cells per page, nullptr if unavailable */
+		MacroCell const *macro_cells = nullptr;
 	};
 }
 
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <cstring>
+#include <functional>
+#include <VMUtils/concepts.hpp>
+#include <VMUtils/attributes.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/core/scene.hpp>
+#include <hydrant/value_range.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* orders block requests and evictions, higher priority is decoded sooner and evicted later */
+	struct IBlockPriority : vm::Dynamic
+	{
+		/* called once per frame, block_to_camera maps block index space to camera space */
+		virtual void update( Camera const &camera, mat4 const &block_to_camera ) = 0;
+
+		virtual float priority( vol::Idx const &idx ) const = 0;
+	};
+
+	struct ImportancePriorityOptions
+	{
+		VM_DEFINE_ATTRIBUTE( float, area_weight ) = 1.f;
+		VM_DEFINE_ATTRIBUTE( float, lod_error_weight ) = 1.f;
+		VM_DEFINE_ATTRIBUTE( float, centre_weight ) = 1.f;
+	};
+
+	/* projected area and value range error, weighted by opacity under the
+	   current transfer function and by closeness to the screen centre */
+	struct ImportancePriority : IBlockPriority
+	{
+		using OpacityFn = std::function<float( vec2 const &range )>;
+
+		ImportancePriority( std::shared_ptr<ValueRangeThumbnail> const &value_range,
+							OpacityFn const &opacity,
+							ImportancePriorityOptions const &opts = ImportancePriorityOptions{} ) :
+		  value_range( value_range ),
+		  opacity( opacity ),
+		  opts( opts ),
+		  keys( value_range->dim() ),
+		  stamps( value_range->dim() )
+		{
+			memset( stamps.data(), 0, stamps.bytes() );
+		}
+
+	public:
+		void update( Camera const &camera, mat4 const &block_to_camera ) override
+		{
+			ctg_fovy_2 = camera.ctg_fovy_2;
+			trans = block_to_camera;
+			frame += 1;
+		}
+
+		/* sorts call this per comparison, so keys are kept until the next update */
+		float priority( vol::Idx const &idx ) const override
+		{
+			auto uidx = uvec3( idx.x, idx.y, idx.z );
+			if ( stamps[ uidx ] != frame ) {
+				keys[ uidx ] = evaluate( uidx );
+				stamps[ uidx ] = frame;
+			}
+			return keys[ uidx ];
+		}
+
+	private:
+		float evaluate( uvec3 const &idx ) const
+		{
+			auto &range = ( *value_range )[ idx ];
+			auto a = opacity( range );
+			if ( a <= 0.f ) return 0.f;
+
+			/* bounding sphere of the block projected to the [ -1, 1 ] screen */
+			const auto radius = .8660254f;
+			vec3 c = trans * vec4( vec3( idx ) + .5f, 1.f );
+			auto z = -c.z;
+			/* wholly behind the eye, nothing of it is on screen */
+			if ( z < -radius ) return 0.f;
+			float area = 1.f, centre = 0.f;
+			if ( length( c ) > radius ) {
+				/* spheres cut by the eye plane are projected from its front,
+				   orthographic cameras keep an infinite ctg_fovy_2 */
+				auto k = isinf( ctg_fovy_2 ) ? 1.f : ctg_fovy_2 / max( z, radius );
+				auto r = radius * k;
+				area = min( 3.1415927f * r * r / 4.f, 1.f );
+				centre = length( vec2( c ) * k );
+			}
+			/* downsampled levels lose the detail spanned by the value range */
+			auto lod_error = ( range.y - range.x ) * area;
+			return a * ( opts.area_weight * area + opts.lod_error_weight * lod_error ) /
+				   ( 1.f + opts.centre_weight * centre );
+		}
+
+	private:
+		std::shared_ptr<ValueRangeThumbnail> value_range;
+		OpacityFn opacity;
+		ImportancePriorityOptions opts;
+		float ctg_fovy_2 = 1.f;
+		mat4 trans;
+		int frame = 1;
+		mutable HostBuffer3D<float> keys;
+		mutable HostBuffer3D<int> stamps;
+	};
+}
+
+VM_END_MODULE()
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <mpi.h>
+#include <VMUtils/concepts.hpp>
+#include <hydrant/mpi_utils.hpp>
+#include <hydrant/octree_culler.hpp>
+#include <hydrant/paging/rt_block_paging.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* hands decoded blocks to their new owner when kd splits move. every rank
+	   knows both partitions, so each old owner sends one message, possibly
+	   empty, to each new owner of part of its region. the receiver holds those
+	   blocks back from its decoder until the message is in, then decodes only
+	   what no rank had */
+	struct BrickMigration : vm::NoCopy, vm::NoMove
+	{
+		static constexpr int tag = 1 << 14;
+
+		BrickMigration( MpiComm const &comm, RtBlockPagingServer &srv ) :
+		  comm( comm ),
+		  srv( srv )
+		{
+		}
+
+		~BrickMigration()
+		{
+			MPI_Waitall( reqs.size(), reqs.data(), MPI_STATUSES_IGNORE );
+		}
+
+	public:
+		/* partitions before and after a rebalance, the same on every rank */
+		void migrate( std::vector<BoundingBox> const &before,
+					  std::vector<BoundingBox> const &after )
+		{
+			auto brick = srv.brick_bytes();
+			/* earlier sends are long done by the time splits move again */
+			MPI_Waitall( reqs.size(), reqs.data(), MPI_STATUSES_IGNORE );
+			reqs.clear();
+			sends.clear();
+
+			for ( int dst = 0; dst != comm.size; ++dst ) {
+				if ( dst == comm.rank ) continue;
+				auto idxs = blocks_in( before[ comm.rank ], after[ dst ] );
+				if ( idxs.empty() ) continue;
+				sends.emplace_back( sizeof( int ) );
+				auto &buf = sends.back();
+				int count = 0;
+				std::vector<unsigned char> voxels( brick );
+				for ( auto &idx : idxs ) {
+					if ( !srv.export_block( idx, voxels.data() ) ) continue;
+					auto off = buf.size();
+					buf.resize( off + sizeof( vol::Idx ) + brick );
+					memcpy( &buf[ off ], &idx, sizeof( vol::Idx ) );
+					memcpy( &buf[ off + sizeof( vol::Idx ) ], voxels.data(), brick );
+					count += 1;
+				}
+				memcpy( buf.data(), &count, sizeof( int ) );
+				reqs.emplace_back();
+				MPI_Isend( buf.data(), buf.size(), MPI_CHAR, dst, tag, comm.comm, &reqs.back() );
+			}
+
+			for ( int src = 0; src != comm.size; ++src ) {
+				if ( src == comm.rank ) continue;
+				auto idxs = blocks_in( before[ src ], after[ comm.rank ] );
+				if ( idxs.empty() ) continue;
+				srv.hold( idxs );
+				incoming.emplace_back( Incoming{ src, std::move( idxs ) } );
+			}
+		}
+
+		/* adopts blocks that arrived, called once per frame before paging */
+		void poll()
+		{
+			std::vector<int> probed;
+			for ( auto it = incoming.begin(); it != incoming.end(); ) {
+				/* messages from one rank arrive in migration order */
+				if ( std::count( probed.begin(), probed.end(), it->src ) ) {
+					++it;
+					continue;
+				}
+				probed.emplace_back( it->src );
+				int flag, len;
+				MPI_Status status;
+				MPI_Iprobe( it->src, tag, comm.comm, &flag, &status );
+				if ( !flag ) {
+					++it;
+					continue;
+				}
+				MPI_Get_count( &status, MPI_CHAR, &len );
+				recv.resize( len );
+				MPI_Recv( recv.data(), len, MPI_CHAR, it->src, tag, comm.comm, MPI_STATUS_IGNORE );
+
+				auto brick = srv.brick_bytes();
+				int count;
+				memcpy( &count, recv.data(), sizeof( int ) );
+				auto p = recv.data() + sizeof( int );
+				for ( int i = 0; i != count; ++i ) {
+					vol::Idx idx;
+					memcpy( &idx, p, sizeof( vol::Idx ) );
+					srv.adopt( idx, reinterpret_cast<unsigned char const *>( p + sizeof( vol::Idx ) ) );
+					p += sizeof( vol::Idx ) + brick;
+				}
+				srv.release( it->idxs );
+				it = incoming.erase( it );
+			}
+		}
+
+	private:
+		static std::vector<vol::Idx> blocks_in( BoundingBox const &a, BoundingBox const &b )
+		{
+			auto lo = max( a.min, b.min );
+			auto hi = min( a.max, b.max );
+			std::vector<vol::Idx> idxs;
+			for ( auto z = lo.z; z < hi.z; ++z ) {
+				for ( auto y = lo.y; y < hi.y; ++y ) {
+					for ( auto x = lo.x; x < hi.x; ++x ) {
+						idxs.emplace_back( vol::Idx{}.set_x( x ).set_y( y ).set_z( z ) );
+					}
+				}
+			}
+			return idxs;
+		}
+
+	private:
+		struct Incoming
+		{
+			int src;
+			std::vector<vol::Idx> idxs;
+		};
+
+		MpiComm comm;
+		RtBlockPagingServer &srv;
+		std::vector<std::vector<char>> sends;
+		std::vector<MPI_Request> reqs;
+		std::vector<Incoming> incoming;
+		std::vector<char> recv;
+	};
+}
+
+VM_END_MODULE()
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <set>
+#include <vector>
+#include <memory>
+#include <VMUtils/option.hpp>
+#include <cudafx/memory.hpp>
+#include <cudafx/device.hpp>
+#include <hydrant/bridge/buffer_3d.hpp>
+#include <hydrant/paging/block_paging.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* per page macro cell ranges, mirrored to device memory on update. set and
+	   update touch the same pages, callers keep them from running at once */
+	struct MacroCellRegistry
+	{
+		MacroCellRegistry( BlockPaging &client,
+						   std::size_t page_count,
+						   int block_size, int padding,
+						   vm::Option<cufx::Device> const &device ) :
+		  block_size( block_size ),
+		  padding( padding ),
+		  host_cells( page_count * MACRO_CELL_COUNT, MacroCell{ 0, 255 } ),
+		  staging( uvec3( block_size + 2 * padding ) )
+		{
+			client.macro_cells = host_cells.data();
+			if ( device.has_value() ) {
+				device_cells.reset( new cufx::GlobalMemory( host_cells.size() * sizeof( MacroCell ),
+															device.value() ) );
+				cufx::memory_transfer( device_cells->view_1d<MacroCell>( host_cells.size() ),
+									   cufx::MemoryView1D<MacroCell>( host_cells.data(), host_cells.size() ) )
+				  .launch();
+				client.macro_cells = reinterpret_cast<MacroCell const *>( device_cells->get() );
+			}
+		}
+
+	public:
+		/* returns the voxels of a decoded block that lives in host or device memory */
+		unsigned char const *to_host( IBuffer3D<unsigned char> const &block )
+		{
+			if ( auto host = dynamic_cast<HostBuffer3D<unsigned char> const *>( &block ) ) {
+				return host->data();
+			}
+			cufx::memory_transfer( staging.view_1d(), block.view_1d() )
+			  .launch();
+			return staging.data();
+		}
+
+		void set( int pgid, unsigned char const *voxels )
+		{
+			compute_macro_cells( voxels, block_size, padding,
+								 host_cells.data() + pgid * MACRO_CELL_COUNT );
+			dirty.insert( pgid );
+		}
+
+		void update()
+		{
+			if ( device_cells ) {
+				auto device_view = device_cells->view_1d<MacroCell>( host_cells.size() );
+				for ( auto pgid : dirty ) {
+					auto off = pgid * MACRO_CELL_COUNT;
+					cufx::memory_transfer( device_view.slice( off, MACRO_CELL_COUNT ),
+										   cufx::MemoryView1D<MacroCell>( host_cells.data() + off,
+																		  MACRO_CELL_COUNT ) )
+					  .launch();
+				}
+			}
+			dirty.clear();
+		}
+
+	private:
+		int block_size, padding;
+		std::vector<MacroCell> host_cells;
+		std::shared_ptr<cufx::GlobalMemory> device_cells;
+		HostBuffer3D<unsigned char> staging;
+		std::set<int> dirty;
+	};
+}
+
+VM_END_MODULE()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include <cudafx/device.hpp>
 #include <cudafx/texture.hpp>
 #include <hydrant/core/renderer.hpp>
@@ -20,6 +21,8 @@ VM_EXPORT
 		VM_DEFINE_ATTRIBUTE( std::shared_ptr<Dataset>, dataset );
 		VM_DEFINE_ATTRIBUTE( vm::Option<cufx::Device>, device );
 		VM_DEFINE_ATTRIBUTE( cufx::Texture::Options, storage_opts );
+		/* host copies of decoded blocks kept to hand over to other ranks */
+		VM_DEFINE_ATTRIBUTE( std::size_t, host_cache_mb ) = 0;
 	};
 
 	struct RtBlockPagingServer : vm::NoCopy, vm::NoMove
@@ -30,6 +33,24 @@ VM_EXPORT
 	public:
 		BlockPaging update( OctreeCuller &culler, Camera const &camera );
 
+		/* blocks requested by the last update that are not resident yet */
+		int pending_blocks() const;
+
+		/* bytes of a padded block */
+		std::size_t brick_bytes() const;
+
+		/* copies a block out of the host cache, false if it is not there */
+		bool export_block( vol::Idx const &idx, unsigned char *voxels ) const;
+
+		/* makes a block decoded elsewhere resident */
+		void adopt( vol::Idx const &idx, unsigned char const *voxels );
+
+		/* held blocks are not requested from the decoder until every hold on
+		   them is released */
+		void hold( std::vector<vol::Idx> const &idxs );
+
+		void release( std::vector<vol::Idx> const &idxs );
+
 		void start();
 
 		void stop();
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cmath>
+#include <VMUtils/modules.hpp>
+#include <hydrant/core/glm_math.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	inline float linear_to_srgb( float x )
+	{
+		if ( x <= 0.0031308f ) {
+			return 12.92f * x;
+		}
+		return 1.055f * std::pow( x, 1.f / 2.4f ) - 0.055f;
+	}
+
+	/* 8 bit srgb encoding of linear [ 0, 1 ] by table lookup, a table step is
+	   at most .2 of an output step so results differ from saturate( linear_to_srgb )
+	   by at most one near a rounding edge */
+	struct SrgbLut
+	{
+		static constexpr int size = 1 << 14;
+
+		SrgbLut()
+		{
+			for ( int i = 0; i != size; ++i ) {
+				table[ i ] = saturate( linear_to_srgb( float( i ) / ( size - 1 ) ) );
+			}
+		}
+
+	public:
+		unsigned char operator()( float x ) const
+		{
+			/* nan maps to 0 */
+			x = x > 0.f ? ( x < 1.f ? x : 1.f ) : 0.f;
+			return table[ int( x * ( size - 1 ) + .5f ) ];
+		}
+
+		uchar3 operator()( vec3 const &v ) const
+		{
+			return uchar3{ ( *this )( v.x ), ( *this )( v.y ), ( *this )( v.z ) };
+		}
+
+		static SrgbLut const &instance()
+		{
+			static SrgbLut lut;
+			return lut;
+		}
+
+	private:
+		unsigned char table[ size ];
+	};
+}
+
+VM_END_MODULE()
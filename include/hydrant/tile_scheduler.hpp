@@ -0,0 +1,168 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <mpi.h>
+#include <cudafx/image.hpp>
+#include <VMUtils/concepts.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/core/raycaster.hpp>
+#include <hydrant/mpi_utils.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* hands out screen tiles to ranks through a shared counter on the leader,
+	   a rank that finishes early just takes the next tile. finished rgb tiles
+	   go to the leader, which puts them into the frame. counters and message
+	   tags rotate over a few frames, frame records keep ranks at most two
+	   frames apart */
+	struct TileScheduler : vm::NoCopy, vm::NoMove
+	{
+		static constexpr int leader = 0;
+		static constexpr int nslots = 4;
+		/* tag + nslots stays below 32767, the smallest MPI_TAG_UB allowed */
+		static constexpr int tag = 1 << 13;
+
+		TileScheduler( MpiComm const &comm, ivec2 const &resolution, int tile_size ) :
+		  comm( comm ),
+		  resolution( resolution ),
+		  tile_size( tile_size ),
+		  ntiles( ( resolution + tile_size - 1 ) / tile_size )
+		{
+			MPI_Win_allocate( comm.rank == leader ? nslots * sizeof( std::int64_t ) : 0,
+							  sizeof( std::int64_t ), MPI_INFO_NULL, comm.comm,
+							  &slots, &win );
+			if ( comm.rank == leader ) {
+				std::fill( slots, slots + nslots, 0 );
+			}
+			MPI_Barrier( comm.comm );
+			MPI_Win_lock_all( 0, win );
+		}
+
+		~TileScheduler()
+		{
+			MPI_Waitall( reqs.size(), reqs.data(), MPI_STATUSES_IGNORE );
+			MPI_Win_unlock_all( win );
+			MPI_Win_free( &win );
+		}
+
+	public:
+		int count() const { return ntiles.x * ntiles.y; }
+
+		/* edge length of a full tile */
+		int size() const { return tile_size; }
+
+		Viewport tile( int i ) const
+		{
+			auto min = ivec2( i % ntiles.x, i / ntiles.x ) * tile_size;
+			return Viewport{}.set_min( min ).set_max( glm::min( min + tile_size, resolution ) );
+		}
+
+		/* clears the counter of two frames ahead, the one every rank left behind */
+		void begin_frame()
+		{
+			MPI_Waitall( reqs.size(), reqs.data(), MPI_STATUSES_IGNORE );
+			reqs.clear();
+			sends.clear();
+			received = 0;
+			if ( comm.rank == leader ) {
+				std::int64_t zero = 0;
+				MPI_Accumulate( &zero, 1, MPI_INT64_T, leader, ( frame_no + 2 ) % nslots,
+								1, MPI_INT64_T, MPI_REPLACE, win );
+				MPI_Win_flush( leader, win );
+			}
+		}
+
+		/* the next tile of this frame, -1 once all are taken */
+		int next()
+		{
+			std::int64_t one = 1, i;
+			MPI_Fetch_and_op( &one, &i, MPI_INT64_T, leader, frame_no % nslots, MPI_SUM, win );
+			MPI_Win_flush( leader, win );
+			return i < count() ? int( i ) : -1;
+		}
+
+		/* rgb rows of a finished tile */
+		void submit( int i, cufx::StdByte3Pixel const *rgb,
+					 cufx::ImageView<cufx::StdByte3Pixel> &frame )
+		{
+			if ( comm.rank == leader ) {
+				place( i, rgb, frame );
+				received += 1;
+				drain( frame, false );
+				return;
+			}
+			auto t = tile( i );
+			auto bytes = ( t.max.x - t.min.x ) * ( t.max.y - t.min.y ) * sizeof( cufx::StdByte3Pixel );
+			sends.emplace_back( sizeof( int ) + bytes );
+			auto &buf = sends.back();
+			memcpy( buf.data(), &i, sizeof( int ) );
+			memcpy( buf.data() + sizeof( int ), rgb, bytes );
+			reqs.emplace_back();
+			MPI_Isend( buf.data(), buf.size(), MPI_CHAR, leader, tag + frame_no % nslots,
+					   comm.comm, &reqs.back() );
+		}
+
+		/* the leader waits for the tiles rendered elsewhere */
+		void end_frame( cufx::ImageView<cufx::StdByte3Pixel> &frame )
+		{
+			if ( comm.rank == leader ) {
+				drain( frame, true );
+			}
+			frame_no += 1;
+		}
+
+	private:
+		void drain( cufx::ImageView<cufx::StdByte3Pixel> &frame, bool wait )
+		{
+			while ( received < count() ) {
+				int flag = 1;
+				MPI_Status status;
+				if ( wait ) {
+					MPI_Probe( MPI_ANY_SOURCE, tag + frame_no % nslots, comm.comm, &status );
+				} else {
+					MPI_Iprobe( MPI_ANY_SOURCE, tag + frame_no % nslots, comm.comm, &flag, &status );
+				}
+				if ( !flag ) return;
+				int len;
+				MPI_Get_count( &status, MPI_CHAR, &len );
+				recv.resize( len );
+				MPI_Recv( recv.data(), len, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG,
+						  comm.comm, MPI_STATUS_IGNORE );
+				int i;
+				memcpy( &i, recv.data(), sizeof( int ) );
+				place( i, reinterpret_cast<cufx::StdByte3Pixel const *>( recv.data() + sizeof( int ) ), frame );
+				received += 1;
+			}
+		}
+
+		void place( int i, cufx::StdByte3Pixel const *rgb,
+					cufx::ImageView<cufx::StdByte3Pixel> &frame ) const
+		{
+			auto t = tile( i );
+			auto w = t.max.x - t.min.x;
+			for ( int y = t.min.y; y < t.max.y; ++y ) {
+				memcpy( &frame.at_host( t.min.x, y ), rgb + ( y - t.min.y ) * w,
+						w * sizeof( cufx::StdByte3Pixel ) );
+			}
+		}
+
+	private:
+		MpiComm comm;
+		ivec2 resolution;
+		int tile_size;
+		ivec2 ntiles;
+		MPI_Win win;
+		std::int64_t *slots = nullptr;
+		int frame_no = 0;
+		int received = 0;
+		std::vector<std::vector<char>> sends;
+		std::vector<MPI_Request> reqs;
+		std::vector<char> recv;
+	};
+}
+
+VM_END_MODULE()
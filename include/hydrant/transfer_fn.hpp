@@ -1,6 +1,9 @@
 #pragma once
 
+#include <thread>
 #include <hydrant/bridge/texture_1d.hpp>
+#include <hydrant/bridge/buffer_3d.hpp>
+#include <hydrant/transfer_fn_lut.hpp>
 #include <hydrant/transfer_fn.schema.hpp>
 
 VM_BEGIN_MODULE( hydrant )
@@ -20,15 +23,161 @@ VM_EXPORT
 									.set_address_mode( cufx::Texture::AddressMode::Border )
 									.set_filter_mode( cufx::Texture::FilterMode::Linear )
 									.set_read_mode( cufx::Texture::ReadMode::Raw )
-									.set_normalize_coords( true ) ) )
+									.set_normalize_coords( true ) ) ),
+		  device( device )
 		{
 			data.resize( cfg.values.size() / 4 );
 			memcpy( data.data(), cfg.values.data(), cfg.values.size() * sizeof( float ) );
 			source( data.data(), false );
+
+			opaque_cnt.resize( data.size() + 1 );
+			opaque_cnt[ 0 ] = 0;
+			for ( int i = 0; i != data.size(); ++i ) {
+				opaque_cnt[ i + 1 ] = opaque_cnt[ i ] + ( data[ i ].w > 0.f );
+			}
+
+			/* sparse table, level k holds the max opacity over entries [ i, i + 2^k ) */
+			alpha_max.emplace_back( data.size() );
+			for ( int i = 0; i != data.size(); ++i ) { alpha_max[ 0 ][ i ] = data[ i ].w; }
+			for ( int k = 1; ( 1 << k ) <= data.size(); ++k ) {
+				auto &prev = alpha_max[ k - 1 ];
+				std::vector<float> level( data.size() - ( 1 << k ) + 1 );
+				for ( int i = 0; i != level.size(); ++i ) {
+					level[ i ] = std::max( prev[ i ], prev[ i + ( 1 << ( k - 1 ) ) ] );
+				}
+				alpha_max.emplace_back( std::move( level ) );
+			}
+
+			/* prefix count of opaque 8 bit voxel value bins, for macro cell tests in shaders */
+			std::vector<float> prefix( 257 );
+			prefix[ 0 ] = 0;
+			for ( int i = 0; i != 256; ++i ) {
+				prefix[ i + 1 ] = prefix[ i ] + !is_transparent( i / 255.f, ( i + 1 ) / 255.f );
+			}
+			opaque_prefix = Texture1D<float>(
+			  Texture1DOptions{}
+				.set_device( device )
+				.set_length( prefix.size() )
+				.set_opts( cufx::Texture::Options{}
+							 .set_address_mode( cufx::Texture::AddressMode::Clamp )
+							 .set_filter_mode( cufx::Texture::FilterMode::None )
+							 .set_read_mode( cufx::Texture::ReadMode::Raw )
+							 .set_normalize_coords( false ) ) );
+			opaque_prefix.source( prefix.data() );
+		}
+
+	public:
+		bool empty() const { return data.empty(); }
+
+		/* bakes len premultiplied entries, opacity corrected for a step of ratio unit
+		   steps, ratio < 1 thins the opacity of denser sampling */
+		void bake_lut( float ratio, int len = 4096 )
+		{
+			lut_data.resize( len );
+			for ( int i = 0; i != len; ++i ) {
+				auto c = lookup( ( i + .5f ) / len );
+				auto a = 1.f - std::pow( 1.f - min( c.w, 1.f ), ratio );
+				lut_data[ i ] = vec4( vec3( c ) * a, a );
+			}
+			if ( device.has_value() ) {
+				lut_tex = Texture1D<vec4>(
+				  Texture1DOptions{}
+					.set_device( device )
+					.set_length( len )
+					.set_opts( cufx::Texture::Options{}
+								 .set_address_mode( cufx::Texture::AddressMode::Clamp )
+								 .set_filter_mode( cufx::Texture::FilterMode::Linear )
+								 .set_read_mode( cufx::Texture::ReadMode::Raw )
+								 .set_normalize_coords( true ) ) );
+				lut_tex.source( lut_data.data() );
+			}
+		}
+
+		TransferFnLut lut() const
+		{
+			TransferFnLut res;
+			if ( device.has_value() ) { res.tex = lut_tex.sampler(); }
+			res.host = lut_data.data();
+			res.len = lut_data.size();
+			return res;
+		}
+
+		/* sampled at k + .5 gives the number of opaque bins in [ 0, k ) */
+		Sampler opaque_prefix_sampler() const { return opaque_prefix.sampler(); }
+
+		/* whether every value in [ lo, hi ] maps to zero opacity under linear filtering */
+		bool is_transparent( float lo, float hi ) const
+		{
+			if ( data.empty() ) return false;
+			int lo_i, hi_i;
+			entry_range( lo, hi, lo_i, hi_i );
+			return opaque_cnt[ hi_i + 1 ] == opaque_cnt[ lo_i ];
+		}
+
+		/* ( front, back ) table of premultiplied segments one step long, ratio is that
+		   step in unit steps ( 1 / sample_rate ). entry i is centered at value ( i + .5 ) / n */
+		HostBuffer3D<vec4> preintegrate( float ratio, int n = 256, int nsubsteps = 32 ) const
+		{
+			HostBuffer3D<vec4> table( uvec3( n, n, 1 ) );
+			auto nthreads = std::max( int( std::thread::hardware_concurrency() ), 1 );
+			std::vector<std::thread> threads;
+			for ( int i = 0; i < nthreads; ++i ) {
+				threads.emplace_back( [&, y0 = i] {
+					for ( int y = y0; y < n; y += nthreads ) {
+						for ( int x = 0; x < n; ++x ) {
+							auto sf = ( x + .5f ) / n;
+							auto sb = ( y + .5f ) / n;
+							vec4 acc( 0 );
+							for ( int k = 0; k != nsubsteps; ++k ) {
+								auto c = lookup( mix( sf, sb, ( k + .5f ) / nsubsteps ) );
+								auto a = 1.f - std::pow( 1.f - min( c.w, 1.f ), ratio / nsubsteps );
+								acc += vec4( vec3( c ) * a, a ) * ( 1.f - acc.w );
+							}
+							table[ uvec3( x, y, 0 ) ] = acc;
+						}
+					}
+				} );
+			}
+			for ( auto &t : threads ) { t.join(); }
+			return table;
+		}
+
+		float max_opacity( float lo, float hi ) const
+		{
+			if ( data.empty() ) return 1.f;
+			int lo_i, hi_i;
+			entry_range( lo, hi, lo_i, hi_i );
+			int k = 0;
+			while ( 2 << k <= hi_i - lo_i + 1 ) ++k;
+			return std::max( alpha_max[ k ][ lo_i ], alpha_max[ k ][ hi_i - ( 1 << k ) + 1 ] );
+		}
+
+	private:
+		/* matches the linear filtered, normalized texture lookup */
+		vec4 lookup( float v ) const
+		{
+			int n = data.size();
+			auto fx = clamp( v * n - .5f, 0.f, float( n - 1 ) );
+			auto i = int( fx );
+			auto j = std::min( i + 1, n - 1 );
+			return mix( data[ i ], data[ j ], fx - i );
+		}
+
+		void entry_range( float lo, float hi, int &lo_i, int &hi_i ) const
+		{
+			int n = data.size();
+			lo_i = clamp( int( floor( lo * n - .5f ) ), 0, n - 1 );
+			hi_i = clamp( int( ceil( hi * n - .5f ) ), 0, n - 1 );
 		}
 
 	private:
 		std::vector<vec4> data;
+		std::vector<int> opaque_cnt;
+		std::vector<std::vector<float>> alpha_max;
+		Texture1D<float> opaque_prefix;
+		vm::Option<cufx::Device> device;
+		std::vector<vec4> lut_data;
+		Texture1D<vec4> lut_tex;
 	};
 }
 
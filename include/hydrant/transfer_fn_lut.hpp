@@ -0,0 +1,32 @@
+#pragma once
+
+#include <VMUtils/modules.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/bridge/sampler.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* dense premultiplied transfer function with opacity corrected to the step size */
+	struct TransferFnLut
+	{
+		__host__ __device__ vec4
+		  sample( float v ) const
+		{
+#if CUFX_DEVICE_CODE
+			return tex.sample_1d<vec4>( v );
+#else
+			/* entry i is centered at ( i + .5 ) / len, same as the filtered texture */
+			return host[ min( int( max( v, 0.f ) * len ), len - 1 ) ];
+#endif
+		}
+
+	public:
+		Sampler tex;
+		vec4 const *host = nullptr;
+		int len = 0;
+	};
+}
+
+VM_END_MODULE()
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <VMUtils/modules.hpp>
+#include <hydrant/core/glm_math.hpp>
+#include <hydrant/core/renderer.hpp>
+#include <hydrant/bridge/buffer_3d.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+VM_EXPORT
+{
+	/* per block [ min, max ] of normalized voxel values, padding included */
+	struct ValueRangeThumbnail : HostBuffer3D<vec2>
+	{
+		using HostBuffer3D<vec2>::HostBuffer3D;
+
+	public:
+		/* loads '<lvl0 archive>.range', builds it from the archive on miss */
+		static std::shared_ptr<ValueRangeThumbnail> load_or_build( Dataset const &dataset );
+
+	private:
+		bool load( std::string const &path );
+
+		void dump( std::string const &path ) const;
+
+		void build( Dataset const &dataset );
+	};
+
+	/* blocks whose value range straddles the isovalue, updated incrementally */
+	struct IsovalueOccupancy
+	{
+		template <typename F>
+		IsovalueOccupancy( std::shared_ptr<ValueRangeThumbnail> const &value_range,
+						   F const &non_empty ) :
+		  value_range( value_range ),
+		  occupied( value_range->dim() )
+		{
+			occupied.iterate_3d( [&]( uvec3 const &idx ) {
+				if ( non_empty( idx ) ) { blocks.emplace_back( idx ); }
+			} );
+			by_min = by_max = blocks;
+			std::sort( by_min.begin(), by_min.end(),
+					   [&]( auto &a, auto &b ) { return range( a ).x < range( b ).x; } );
+			std::sort( by_max.begin(), by_max.end(),
+					   [&]( auto &a, auto &b ) { return range( a ).y < range( b ).y; } );
+		}
+
+	public:
+		/* returns whether any block changed its occupancy */
+		bool update( float isovalue )
+		{
+			if ( !initialized ) {
+				initialized = true;
+				for ( auto &idx : blocks ) { occupied[ idx ] = straddles( idx, isovalue ); }
+				curr = isovalue;
+				return true;
+			}
+			auto lo = std::min( curr, isovalue );
+			auto hi = std::max( curr, isovalue );
+			curr = isovalue;
+			if ( lo == hi ) return false;
+			/* only blocks with an endpoint in [ lo, hi ] can flip */
+			bool changed = false;
+			auto flip = [&]( std::vector<uvec3> const &sorted, int comp ) {
+				auto first = std::lower_bound( sorted.begin(), sorted.end(), lo,
+											   [&]( auto &idx, float v ) { return range( idx )[ comp ] < v; } );
+				for ( auto it = first; it != sorted.end() && range( *it )[ comp ] <= hi; ++it ) {
+					char occ = straddles( *it, isovalue );
+					if ( occupied[ *it ] != occ ) {
+						occupied[ *it ] = occ;
+						changed = true;
+					}
+				}
+			};
+			flip( by_min, 0 );
+			flip( by_max, 1 );
+			return changed;
+		}
+
+		bool is_occupied( uvec3 const &idx ) const { return occupied[ idx ]; }
+
+	private:
+		vec2 const &range( uvec3 const &idx ) const { return ( *value_range )[ idx ]; }
+
+		char straddles( uvec3 const &idx, float isovalue ) const
+		{
+			auto &r = range( idx );
+			return r.x <= isovalue && isovalue <= r.y;
+		}
+
+	private:
+		std::shared_ptr<ValueRangeThumbnail> value_range;
+		std::vector<uvec3> blocks, by_min, by_max;
+		HostBuffer3D<char> occupied;
+		bool initialized = false;
+		float curr = 0.f;
+	};
+
+	/* chebyshev distance in blocks to the nearest occupied block, 0 if occupied */
+	struct ChebyshevField : HostBuffer3D<int>
+	{
+		using HostBuffer3D<int>::HostBuffer3D;
+
+	public:
+		template <typename F>
+		void rebuild( F const &occupied )
+		{
+			auto d = ivec3( this->dim() );
+			auto inf = compMax( d );
+			this->iterate_3d( [&]( uvec3 const &idx ) {
+				( *this )[ idx ] = occupied( idx ) ? 0 : inf;
+			} );
+			/* two pass chamfer transform, exact for L-inf with unit 26-neighbourhood */
+			ivec3 idx;
+			for ( idx.z = 0; idx.z != d.z; ++idx.z ) {
+				for ( idx.y = 0; idx.y != d.y; ++idx.y ) {
+					for ( idx.x = 0; idx.x != d.x; ++idx.x ) {
+						relax( idx, d, -1 );
+					}
+				}
+			}
+			for ( idx.z = d.z - 1; idx.z >= 0; --idx.z ) {
+				for ( idx.y = d.y - 1; idx.y >= 0; --idx.y ) {
+					for ( idx.x = d.x - 1; idx.x >= 0; --idx.x ) {
+						relax( idx, d, 1 );
+					}
+				}
+			}
+		}
+
+	private:
+		void relax( ivec3 const &idx, ivec3 const &d, int dir )
+		{
+			auto &v = ( *this )[ uvec3( idx ) ];
+			if ( v == 0 ) return;
+			ivec3 dx;
+			for ( dx.z = -1; dx.z <= 1; ++dx.z ) {
+				for ( dx.y = -1; dx.y <= 1; ++dx.y ) {
+					for ( dx.x = -1; dx.x <= 1; ++dx.x ) {
+						/* only visit neighbours already swept in this pass */
+						auto ord = dx.z != 0 ? dx.z : dx.y != 0 ? dx.y : dx.x;
+						if ( ord != dir ) continue;
+						auto nb = idx + dx;
+						if ( any( lessThan( nb, ivec3( 0 ) ) ) ||
+							 any( greaterThanEqual( nb, d ) ) ) {
+							continue;
+						}
+						v = min( v, ( *this )[ uvec3( nb ) ] + 1 );
+					}
+				}
+			}
+		}
+	};
+}
+
+VM_END_MODULE()
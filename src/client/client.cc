@@ -1,4 +1,5 @@
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,7 +12,11 @@
 //#include <cpprest/ws_client.h>
 #include <websocketpp/config/asio_no_tls_client.hpp>
 #include <websocketpp/client.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stbi/stb_image.h>
+#include <hydrant/frame_packet.hpp>
 #include "client.hpp"
+#include "h264_decoder.hpp"
 
 VM_BEGIN_MODULE( hydrant )
 
@@ -30,6 +35,11 @@ struct ClientImpl : GlfwRenderLoop
 	  ctrl_ui( UiFactory{}.create( cfg.params.render.renderer ) ),
 	  config( cfg )
 	{
+#ifndef HYDRA_WITH_OPENH264
+		if ( config.params.encoding.format == FrameFormat::H264 ) {
+			config.params.encoding.format = FrameFormat::Jpeg;
+		}
+#endif
 		g_clt = this;
 		worker = std::thread( [this, addr] { this->worker_loop( addr ); } );
 	}
@@ -76,12 +86,42 @@ private:
 	{
 		auto &payload = msg->get_raw_payload();
 		int32_t type = 0;
+		if ( payload.size() < sizeof( type ) ) return;
 		memcpy( &type, payload.data(), sizeof( type ) );
 		switch ( type ) {
 		case 0: {
+			FramePacketHeader hdr;
+			auto pkt = payload.data() + sizeof( type );
+			auto len = payload.size() - sizeof( type );
+			if ( len < sizeof( hdr ) ) {
+				LOG( WARNING ) << "dropped truncated frame packet";
+				break;
+			}
+			memcpy( &hdr, pkt, sizeof( hdr ) );
+			if ( !is_valid_frame( hdr, pkt + sizeof( hdr ), len - sizeof( hdr ) ) ) {
+				LOG( WARNING ) << "dropped malformed frame packet";
+				break;
+			}
+#ifdef HYDRA_WITH_OPENH264
+			if ( hdr.format != FrameFormat::H264 ) {
+				h264.reset();
+			}
+#endif
+			if ( hdr.format == FrameFormat::H264 && !decode_h264( hdr, pkt + sizeof( hdr ) ) ) {
+				break;
+			}
+			if ( hdr.format == FrameFormat::Jpeg ) {
+				decode_jpeg( hdr, pkt + sizeof( hdr ) );
+			}
 			std::unique_lock<std::mutex> lk( frame_mtx );
-			payload_buf = std::move( payload );
-			frame_ptr = payload_buf.data() + sizeof( type );
+			frame_res = ivec2( hdr.width, hdr.height );
+			if ( hdr.format != FrameFormat::Raw ) {
+				std::swap( frame_buf, decoded );
+				frame_ptr = frame_buf.data();
+			} else {
+				payload_buf = std::move( payload );
+				frame_ptr = payload_buf.data() + sizeof( type ) + sizeof( hdr );
+			}
 			++nframes;
 		} break;
 		case 1:
@@ -90,6 +130,90 @@ private:
 		}
 	}
 
+	/* checks the layout the header claims against the bytes that came, so the
+	   decoders below only see payloads that hold what they read */
+	bool is_valid_frame( FramePacketHeader const &hdr, char const *data, std::size_t len ) const
+	{
+		const int max_dim = 1 << 14;
+		if ( hdr.width <= 0 || hdr.height <= 0 || hdr.width > max_dim || hdr.height > max_dim ) {
+			return false;
+		}
+		switch ( hdr.format ) {
+		case FrameFormat::Raw: return len >= std::size_t( hdr.width ) * hdr.height * 3;
+		case FrameFormat::Jpeg:
+		case FrameFormat::H264: break;
+		default: return false;
+		}
+		if ( hdr.nstripes <= 0 || hdr.stripe_rows <= 0 ||
+			 int64_t( hdr.nstripes - 1 ) * hdr.stripe_rows >= hdr.height ||
+			 len / sizeof( int32_t ) < std::size_t( hdr.nstripes ) ) {
+			return false;
+		}
+		std::size_t total = hdr.nstripes * sizeof( int32_t );
+		for ( int i = 0; i != hdr.nstripes; ++i ) {
+			int32_t size;
+			memcpy( &size, data + i * sizeof( int32_t ), sizeof( size ) );
+			if ( size < 0 ) return false;
+			total += size;
+		}
+		return total <= len;
+	}
+
+	/* stripes decode into rows of the frame in order, rows a stripe fails to
+	   cover are cleared rather than left from an older frame */
+	void decode_jpeg( FramePacketHeader const &hdr, char const *data )
+	{
+		auto row_bytes = hdr.width * 3;
+		decoded.resize( hdr.height * row_bytes );
+		std::vector<int32_t> sizes( hdr.nstripes );
+		memcpy( sizes.data(), data, sizes.size() * sizeof( int32_t ) );
+		auto src = reinterpret_cast<stbi_uc const *>( data + sizes.size() * sizeof( int32_t ) );
+		for ( int i = 0; i != hdr.nstripes; ++i ) {
+			auto y0 = i * hdr.stripe_rows;
+			auto rows = std::max( std::min( hdr.stripe_rows, hdr.height - y0 ), 0 );
+			auto dst = decoded.data() + y0 * row_bytes;
+			int w, h = 0, n;
+			auto px = stbi_load_from_memory( src, sizes[ i ], &w, &h, &n, 3 );
+			src += sizes[ i ];
+			if ( !px ) {
+				LOG( WARNING ) << vm::fmt( "failed to decode frame stripe: {}", stbi_failure_reason() );
+				h = 0;
+			} else if ( w != hdr.width ) {
+				LOG( WARNING ) << vm::fmt( "frame stripe is {} wide, expected {}", w, hdr.width );
+				h = 0;
+			}
+			h = std::min( h, rows );
+			if ( h ) {
+				memcpy( dst, px, h * row_bytes );
+			}
+			memset( dst + h * row_bytes, 0, ( rows - h ) * row_bytes );
+			if ( px ) {
+				stbi_image_free( px );
+			}
+		}
+		auto covered = std::min( hdr.nstripes * hdr.stripe_rows, hdr.height );
+		memset( decoded.data() + covered * row_bytes, 0, ( hdr.height - covered ) * row_bytes );
+	}
+
+	/* true once a picture is out, a broken stream asks for a keyframe */
+	bool decode_h264( FramePacketHeader const &hdr, char const *data )
+	{
+		bool picture = false;
+#ifdef HYDRA_WITH_OPENH264
+		int32_t size;
+		memcpy( &size, data, sizeof( size ) );
+		if ( !h264 ) {
+			h264.reset( new H264Decoder );
+		}
+		if ( !h264->decode( data + sizeof( size ), size, hdr.width, hdr.height,
+							decoded, picture ) ) {
+			LOG( WARNING ) << "h264 stream broken, requesting a keyframe";
+			want_keyframe = true;
+		}
+#endif
+		return picture;
+	}
+
 private:
 	static void g_on_open( wspp::connection_hdl hdl )
 	{
@@ -115,7 +239,7 @@ public:
 			glPixelZoom( 1, -1 );
 		
 			check_gl_error();
-			glDrawPixels( resolution.x, resolution.y, GL_RGB, GL_UNSIGNED_BYTE, frame_ptr );
+			glDrawPixels( frame_res.x, frame_res.y, GL_RGB, GL_UNSIGNED_BYTE, frame_ptr );
 			check_gl_error();
 		
 			glEnable( GL_DEPTH_TEST );
@@ -224,9 +348,13 @@ private:
 			prev = time;
 		}
 		ImGui::Text( "FPS: %d", fps );
+		ui_encoding_bar();
 		ui_renderer_bar();
 		ImGui::End();
 
+		if ( want_keyframe.exchange( false ) ) {
+			config.params.encoding.keyframe += 1;
+		}
 		update_config();
 	}
 
@@ -244,6 +372,27 @@ private:
 		//		arm.y = degrees( arm.y );
 	}
 
+	void ui_encoding_bar()
+	{
+		auto &encoding = config.params.encoding;
+		if ( ImGui::BeginCombo( "Frame Format", encoding.format._to_string() ) ) {
+			for ( auto format : FrameFormat::_values() ) {
+#ifndef HYDRA_WITH_OPENH264
+				if ( format == FrameFormat::H264 ) continue;
+#endif
+				if ( ImGui::Selectable( format._to_string(), format == encoding.format ) ) {
+					encoding.format = format;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if ( encoding.format == FrameFormat::Jpeg ) {
+			ImGui::SliderInt( "Quality", &encoding.quality, 10, 100 );
+		} else if ( encoding.format == FrameFormat::H264 ) {
+			ImGui::SliderInt( "Bitrate (kbps)", &encoding.bitrate_kbps, 500, 50000 );
+		}
+	}
+
 	void ui_renderer_bar()
 	{
 		if ( ImGui::CollapsingHeader( "Basic", ImGuiTreeNodeFlags_DefaultOpen ) ) {
@@ -315,7 +464,13 @@ private:
 	wspp::connection_hdl hdl;
 	std::mutex frame_mtx;
 	std::string payload_buf;
+	std::vector<char> frame_buf, decoded;
+#ifdef HYDRA_WITH_OPENH264
+	std::unique_ptr<H264Decoder> h264;
+#endif
+	std::atomic<bool> want_keyframe{ false };
 	const char *frame_ptr = nullptr;
+	ivec2 frame_res;
 	
 	Config config;
     bool is_connected = false;
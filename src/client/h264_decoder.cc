@@ -0,0 +1,83 @@
+#ifdef HYDRA_WITH_OPENH264
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <wels/codec_api.h>
+#include "h264_decoder.hpp"
+
+VM_BEGIN_MODULE( hydrant )
+
+namespace
+{
+inline char clamp8( int x )
+{
+	return char( std::min( std::max( x, 0 ), 255 ) );
+}
+
+/* bt.601 limited range, the inverse of the leader's conversion */
+void i420_to_rgb( unsigned char const *const *planes, int const *strides,
+				  int width, int height, char *rgb )
+{
+	for ( int y = 0; y != height; ++y ) {
+		auto py = planes[ 0 ] + y * strides[ 0 ];
+		auto pu = planes[ 1 ] + y / 2 * strides[ 1 ];
+		auto pv = planes[ 2 ] + y / 2 * strides[ 1 ];
+		for ( int x = 0; x != width; ++x, rgb += 3 ) {
+			auto c = 298 * ( py[ x ] - 16 ) + 128;
+			auto d = pu[ x / 2 ] - 128;
+			auto e = pv[ x / 2 ] - 128;
+			rgb[ 0 ] = clamp8( ( c + 409 * e ) >> 8 );
+			rgb[ 1 ] = clamp8( ( c - 100 * d - 208 * e ) >> 8 );
+			rgb[ 2 ] = clamp8( ( c + 516 * d ) >> 8 );
+		}
+	}
+}
+
+}  // namespace
+
+H264Decoder::H264Decoder()
+{
+	if ( WelsCreateDecoder( &dec ) != 0 || !dec ) {
+		throw std::runtime_error( "failed to create h264 decoder" );
+	}
+	SDecodingParam param;
+	memset( &param, 0, sizeof( param ) );
+	param.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+	param.eEcActiveIdc = ERROR_CON_DISABLE;
+	if ( dec->Initialize( &param ) != cmResultSuccess ) {
+		WelsDestroyDecoder( dec );
+		throw std::runtime_error( "failed to initialize h264 decoder" );
+	}
+}
+
+H264Decoder::~H264Decoder()
+{
+	dec->Uninitialize();
+	WelsDestroyDecoder( dec );
+}
+
+bool H264Decoder::decode( char const *data, int len, int width, int height,
+						  std::vector<char> &rgb, bool &picture )
+{
+	picture = false;
+	if ( !len ) return true;
+	unsigned char *planes[ 3 ] = {};
+	SBufferInfo info;
+	memset( &info, 0, sizeof( info ) );
+	auto state = dec->DecodeFrameNoDelay( reinterpret_cast<unsigned char const *>( data ),
+										  len, planes, &info );
+	if ( state != dsErrorFree ) return false;
+	if ( info.iBufferStatus != 1 ) return true;
+	/* the stream pads odd sizes to even ones, a smaller picture is not ours */
+	auto &buf = info.UsrData.sSystemBuffer;
+	if ( buf.iWidth < width || buf.iHeight < height ) return false;
+	rgb.resize( width * height * 3 );
+	i420_to_rgb( planes, buf.iStride, width, height, rgb.data() );
+	picture = true;
+	return true;
+}
+
+VM_END_MODULE()
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <VMUtils/modules.hpp>
+
+class ISVCDecoder;
+
+VM_BEGIN_MODULE( hydrant )
+
+/* openh264 counterpart of the leader's stream, decodes each access unit as
+   it arrives without reordering delay */
+struct H264Decoder
+{
+	H264Decoder();
+	~H264Decoder();
+
+public:
+	/* picture tells whether rgb now holds a width x height frame, false is
+	   returned when the stream is broken and needs an idr frame to go on */
+	bool decode( char const *data, int len, int width, int height,
+				 std::vector<char> &rgb, bool &picture );
+
+private:
+	ISVCDecoder *dec = nullptr;
+};
+
+VM_END_MODULE()
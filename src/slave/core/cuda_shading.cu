@@ -17,12 +17,13 @@ __global__ void
 	uint x = blockIdx.x * blockDim.x + threadIdx.x;
 	uint y = blockIdx.y * blockDim.y + threadIdx.y;
 
-	if ( x >= args.image_desc.resolution.x || y >= args.image_desc.resolution.y ) {
+	if ( x >= args.image_desc.extent.x || y >= args.image_desc.extent.y ) {
 		return;
 	}
 
 	auto cc = vec2( args.image_desc.resolution ) / 2.f;
-	auto uv = ( vec2{ x, y } - cc ) * 2.f / float( args.image_desc.resolution.y );
+	auto px = vec2( args.image_desc.origin ) + vec2{ x, y };
+	auto uv = ( px - cc ) * 2.f / float( args.image_desc.resolution.y );
 	Ray ray = {
 		args.view.ray_o,
 		normalize( vec3( args.view.trans * vec4( uv.x, -uv.y, -args.view.ctg_fovy_2, 1 ) ) - args.view.ray_o )
@@ -30,7 +31,7 @@ __global__ void
 
 	auto shader = (ray_emit_shader_t *)args.function_desc.fp;
 	shader( ray,
-			args.image_desc.data + args.image_desc.pixel_size * ( args.image_desc.resolution.x * y + x ),
+			args.image_desc.at( x, y ),
 			shader_args_buffer + args.function_desc.offset );
 }
 
@@ -44,12 +45,12 @@ __global__ void
 	uint x = blockIdx.x * blockDim.x + threadIdx.x;
 	uint y = blockIdx.y * blockDim.y + threadIdx.y;
 
-	if ( x >= args.image_desc.resolution.x || y >= args.image_desc.resolution.y ) {
+	if ( x >= args.image_desc.extent.x || y >= args.image_desc.extent.y ) {
 		return;
 	}
 
 	auto shader = (ray_march_shader_t *)args.function_desc.fp;
-	shader( args.image_desc.data + args.image_desc.pixel_size * ( args.image_desc.resolution.x * y + x ),
+	shader( args.image_desc.at( x, y ),
 			shader_args_buffer + args.function_desc.offset );
 }
 
@@ -63,13 +64,13 @@ __global__ void
 	uint x = blockIdx.x * blockDim.x + threadIdx.x;
 	uint y = blockIdx.y * blockDim.y + threadIdx.y;
 
-	if ( x >= args.image_desc.resolution.x || y >= args.image_desc.resolution.y ) {
+	if ( x >= args.image_desc.extent.x || y >= args.image_desc.extent.y ) {
 		return;
 	}
 
 	auto shader = (pixel_shader_t *)args.function_desc.fp;
-	shader( args.image_desc.data + args.image_desc.pixel_size * ( args.image_desc.resolution.x * y + x ),
-			args.dst_desc.data + args.dst_desc.pixel_size * ( args.dst_desc.resolution.x * y + x ),
+	shader( args.image_desc.at( x, y ),
+			args.dst_desc.at( x, y ),
 			&args.clear_color );
 }
 
@@ -83,13 +84,13 @@ __global__ void
 	uint x = blockIdx.x * blockDim.x + threadIdx.x;
 	uint y = blockIdx.y * blockDim.y + threadIdx.y;
 
-	if ( x >= args.image_desc.resolution.x || y >= args.image_desc.resolution.y ) {
+	if ( x >= args.image_desc.extent.x || y >= args.image_desc.extent.y ) {
 		return;
 	}
 
 	auto shader = (fetch_shader_t *)args.function_desc.fp;
-	shader( args.image_desc.data + args.image_desc.pixel_size * ( args.image_desc.resolution.x * y + x ),
-			args.dst_desc.data + args.dst_desc.pixel_size * ( args.dst_desc.resolution.x * y + x ),
+	shader( args.image_desc.at( x, y ),
+			args.dst_desc.at( x, y ),
 			shader_args_buffer + args.function_desc.offset );
 }
 
@@ -0,0 +1,94 @@
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <glog/logging.h>
+#include "voxer/Image.hpp"
+#include "frame_encoder.hpp"
+#include "h264_encoder.hpp"
+
+VM_BEGIN_MODULE( hydrant )
+
+FrameEncoder::FrameEncoder() = default;
+
+FrameEncoder::~FrameEncoder() = default;
+
+void FrameEncoder::encode( cufx::Image<> &frame, FrameEncodingConfig const &opts_in,
+						   std::vector<char> &out )
+{
+	auto opts = opts_in;
+#ifndef HYDRA_WITH_OPENH264
+	if ( opts.format == FrameFormat::H264 ) {
+		LOG_FIRST_N( WARNING, 1 ) << "built without openh264, sending jpeg frames";
+		opts.format = FrameFormat::Jpeg;
+	}
+#else
+	/* a stream left for another format restarts with an idr */
+	if ( opts.format != FrameFormat::H264 ) {
+		h264.reset();
+	}
+#endif
+	auto hdr = FramePacketHeader{ opts.format._to_integral(),
+								  int32_t( frame.get_width() ),
+								  int32_t( frame.get_height() ), 1, 0 };
+	auto row_bytes = hdr.width * sizeof( uchar3 );
+	auto src = reinterpret_cast<uint8_t const *>( &frame.at( 0, 0 ) );
+
+	if ( opts.format == FrameFormat::Raw ) {
+		hdr.stripe_rows = hdr.height;
+		out.resize( sizeof( hdr ) + hdr.height * row_bytes );
+		memcpy( out.data(), &hdr, sizeof( hdr ) );
+		memcpy( out.data() + sizeof( hdr ), src, hdr.height * row_bytes );
+		return;
+	}
+
+#ifdef HYDRA_WITH_OPENH264
+	if ( opts.format == FrameFormat::H264 ) {
+		if ( !h264 || h264->width != hdr.width || h264->height != hdr.height ) {
+			h264.reset( new H264Encoder( hdr.width, hdr.height, opts ) );
+		}
+		hdr.stripe_rows = hdr.height;
+		stripes.resize( 1 );
+		h264->encode( frame, opts, stripes[ 0 ] );
+	} else
+#endif
+	{
+		/* stripes span whole 16 row mcus so they cost no extra padding */
+		const int min_rows = 64;
+		auto nthreads = std::max( int( std::thread::hardware_concurrency() ), 1 );
+		hdr.nstripes = std::max( std::min( nthreads, hdr.height / min_rows ), 1 );
+		hdr.stripe_rows = ( ( hdr.height + hdr.nstripes - 1 ) / hdr.nstripes + 15 ) / 16 * 16;
+		hdr.nstripes = ( hdr.height + hdr.stripe_rows - 1 ) / hdr.stripe_rows;
+		auto quality = voxer::Image::Quality( std::min( std::max( opts.quality, 1 ), 100 ) );
+
+		stripes.resize( hdr.nstripes );
+		std::vector<std::thread> threads;
+		for ( int i = 0; i != hdr.nstripes; ++i ) {
+			threads.emplace_back( [&, i] {
+				auto y0 = i * hdr.stripe_rows;
+				auto rows = std::min( hdr.stripe_rows, hdr.height - y0 );
+				stripes[ i ] = voxer::Image::encode( src + y0 * row_bytes, hdr.width, rows, 3,
+													 voxer::Image::Format::JPEG, quality, false )
+								 .data;
+			} );
+		}
+		for ( auto &t : threads ) { t.join(); }
+	}
+
+	auto len = sizeof( hdr ) + hdr.nstripes * sizeof( int32_t );
+	for ( auto &s : stripes ) { len += s.size(); }
+	out.resize( len );
+	auto p = out.data();
+	memcpy( p, &hdr, sizeof( hdr ) );
+	p += sizeof( hdr );
+	for ( auto &s : stripes ) {
+		auto size = int32_t( s.size() );
+		memcpy( p, &size, sizeof( size ) );
+		p += sizeof( size );
+	}
+	for ( auto &s : stripes ) {
+		memcpy( p, s.data(), s.size() );
+		p += s.size();
+	}
+}
+
+VM_END_MODULE()
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cudafx/image.hpp>
+#include <hydrant/config.schema.hpp>
+#include <hydrant/frame_packet.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+struct H264Encoder;
+
+/* packs frames for the zookeeper. jpeg frames are cut into row stripes that
+   are encoded on their own threads and decoded one by one on the client,
+   h264 frames continue a stream that restarts whenever the size or the
+   format changes */
+struct FrameEncoder
+{
+	FrameEncoder();
+	~FrameEncoder();
+
+	/* header and payload of a frame, out is reused across frames */
+	void encode( cufx::Image<> &frame, FrameEncodingConfig const &opts,
+				 std::vector<char> &out );
+
+private:
+	std::vector<std::vector<unsigned char>> stripes;
+#ifdef HYDRA_WITH_OPENH264
+	std::unique_ptr<H264Encoder> h264;
+#endif
+};
+
+VM_END_MODULE()
@@ -0,0 +1,230 @@
+#ifdef HYDRA_WITH_OPENH264
+
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <glog/logging.h>
+#include <wels/codec_api.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "h264_encoder.hpp"
+
+VM_BEGIN_MODULE( hydrant )
+
+namespace
+{
+inline unsigned char luma( int r, int g, int b )
+{
+	return ( ( 66 * r + 129 * g + 25 * b + 128 ) >> 8 ) + 16;
+}
+
+/* r, g, b are sums over a 2x2 block */
+inline void chroma( int r, int g, int b, unsigned char &u, unsigned char &v )
+{
+	r = ( r + 2 ) >> 2;
+	g = ( g + 2 ) >> 2;
+	b = ( b + 2 ) >> 2;
+	u = ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128;
+	v = ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128;
+}
+
+#ifdef __SSE2__
+inline void load8( uchar3 const *p, __m128i &r, __m128i &g, __m128i &b )
+{
+	r = _mm_setr_epi16( p[ 0 ].x, p[ 1 ].x, p[ 2 ].x, p[ 3 ].x,
+						p[ 4 ].x, p[ 5 ].x, p[ 6 ].x, p[ 7 ].x );
+	g = _mm_setr_epi16( p[ 0 ].y, p[ 1 ].y, p[ 2 ].y, p[ 3 ].y,
+						p[ 4 ].y, p[ 5 ].y, p[ 6 ].y, p[ 7 ].y );
+	b = _mm_setr_epi16( p[ 0 ].z, p[ 1 ].z, p[ 2 ].z, p[ 3 ].z,
+						p[ 4 ].z, p[ 5 ].z, p[ 6 ].z, p[ 7 ].z );
+}
+
+/* the weighted sum stays below 1 << 16, so the logical shift is exact */
+inline void luma8( __m128i r, __m128i g, __m128i b, unsigned char *y )
+{
+	auto s = _mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( r, _mm_set1_epi16( 66 ) ),
+										   _mm_mullo_epi16( g, _mm_set1_epi16( 129 ) ) ),
+							_mm_add_epi16( _mm_mullo_epi16( b, _mm_set1_epi16( 25 ) ),
+										   _mm_set1_epi16( 128 ) ) );
+	s = _mm_add_epi16( _mm_srli_epi16( s, 8 ), _mm_set1_epi16( 16 ) );
+	_mm_storel_epi64( reinterpret_cast<__m128i *>( y ), _mm_packus_epi16( s, s ) );
+}
+
+/* sums horizontal pairs of a two row sum and rounds to the block mean */
+inline __m128i mean4( __m128i s )
+{
+	s = _mm_madd_epi16( s, _mm_set1_epi16( 1 ) );
+	s = _mm_packs_epi32( s, s );
+	return _mm_srli_epi16( _mm_add_epi16( s, _mm_set1_epi16( 2 ) ), 2 );
+}
+
+inline void chroma4( __m128i r, __m128i g, __m128i b, __m128i cr, __m128i cg, __m128i cb,
+					 unsigned char *dst )
+{
+	auto s = _mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( r, cr ), _mm_mullo_epi16( g, cg ) ),
+							_mm_add_epi16( _mm_mullo_epi16( b, cb ), _mm_set1_epi16( 128 ) ) );
+	s = _mm_add_epi16( _mm_srai_epi16( s, 8 ), _mm_set1_epi16( 128 ) );
+	auto px = _mm_cvtsi128_si32( _mm_packus_epi16( s, s ) );
+	memcpy( dst, &px, 4 );
+}
+#endif
+
+/* bt.601 limited range i420 with chroma averaged over 2x2 pixels, the
+   picture is w x h rounded up to even sizes by repeating the last row and
+   column. rows keep the frame order, as jpeg stripes do */
+void rgb_to_i420( uchar3 const *rgb, int w, int h, int pw, int ph,
+				  unsigned char *y, unsigned char *u, unsigned char *v )
+{
+	auto row = [&]( int i ) { return rgb + std::min( i, h - 1 ) * w; };
+	for ( int cy = 0; cy != ph / 2; ++cy ) {
+		auto s0 = row( 2 * cy ), s1 = row( 2 * cy + 1 );
+		auto y0 = y + 2 * cy * pw, y1 = y0 + pw;
+		auto u0 = u + cy * ( pw / 2 ), v0 = v + cy * ( pw / 2 );
+		int x = 0;
+#ifdef __SSE2__
+		const auto ur = _mm_set1_epi16( -38 ), ug = _mm_set1_epi16( -74 ), ub = _mm_set1_epi16( 112 );
+		const auto vr = _mm_set1_epi16( 112 ), vg = _mm_set1_epi16( -94 ), vb = _mm_set1_epi16( -18 );
+		for ( ; x + 8 <= w; x += 8 ) {
+			__m128i r0, g0, b0, r1, g1, b1;
+			load8( s0 + x, r0, g0, b0 );
+			load8( s1 + x, r1, g1, b1 );
+			luma8( r0, g0, b0, y0 + x );
+			luma8( r1, g1, b1, y1 + x );
+			auto r = mean4( _mm_add_epi16( r0, r1 ) );
+			auto g = mean4( _mm_add_epi16( g0, g1 ) );
+			auto b = mean4( _mm_add_epi16( b0, b1 ) );
+			chroma4( r, g, b, ur, ug, ub, u0 + x / 2 );
+			chroma4( r, g, b, vr, vg, vb, v0 + x / 2 );
+		}
+#endif
+		for ( ; x < pw; x += 2 ) {
+			auto x1 = std::min( x + 1, w - 1 );
+			uchar3 const px[] = { s0[ std::min( x, w - 1 ) ], s0[ x1 ], s1[ std::min( x, w - 1 ) ], s1[ x1 ] };
+			int r = 0, g = 0, b = 0;
+			for ( int i = 0; i != 4; ++i ) {
+				auto l = luma( px[ i ].x, px[ i ].y, px[ i ].z );
+				( i < 2 ? y0 : y1 )[ x + i % 2 ] = l;
+				r += px[ i ].x;
+				g += px[ i ].y;
+				b += px[ i ].z;
+			}
+			chroma( r, g, b, u0[ x / 2 ], v0[ x / 2 ] );
+		}
+	}
+}
+
+}  // namespace
+
+H264Encoder::H264Encoder( int width, int height, FrameEncodingConfig const &opts ) :
+  width( width ),
+  height( height ),
+  pic_width( ( width + 1 ) & ~1 ),
+  pic_height( ( height + 1 ) & ~1 ),
+  yuv( pic_width * pic_height * 3 / 2 ),
+  bitrate_kbps( opts.bitrate_kbps ),
+  keyframe( opts.keyframe )
+{
+	if ( WelsCreateSVCEncoder( &enc ) != 0 || !enc ) {
+		throw std::runtime_error( "failed to create h264 encoder" );
+	}
+	SEncParamExt param;
+	enc->GetDefaultParams( &param );
+	param.iUsageType = CAMERA_VIDEO_REAL_TIME;
+	param.iPicWidth = pic_width;
+	param.iPicHeight = pic_height;
+	param.fMaxFrameRate = 60.f;
+	param.iRCMode = RC_BITRATE_MODE;
+	param.iTargetBitrate = bitrate_kbps * 1000;
+	param.iMaxBitrate = UNSPECIFIED_BIT_RATE;
+	param.bEnableFrameSkip = false;
+	param.uiIntraPeriod = 0;
+	param.eSpsPpsIdStrategy = CONSTANT_ID;
+	param.iEntropyCodingModeFlag = 0;
+	param.iComplexityMode = LOW_COMPLEXITY;
+	param.bEnableBackgroundDetection = false;
+	param.bEnableSceneChangeDetect = false;
+	param.bEnableDenoise = false;
+	param.iTemporalLayerNum = 1;
+	param.iSpatialLayerNum = 1;
+	param.iMultipleThreadIdc = std::min( std::max( int( std::thread::hardware_concurrency() ), 1 ), 8 );
+	auto &layer = param.sSpatialLayers[ 0 ];
+	layer.iVideoWidth = pic_width;
+	layer.iVideoHeight = pic_height;
+	layer.fFrameRate = param.fMaxFrameRate;
+	layer.iSpatialBitrate = param.iTargetBitrate;
+	layer.iMaxSpatialBitrate = param.iMaxBitrate;
+	/* one slice per encoder thread, rows of macroblocks are split evenly */
+	layer.sSliceArgument.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+	layer.sSliceArgument.uiSliceNum = param.iMultipleThreadIdc;
+	if ( enc->InitializeExt( &param ) != cmResultSuccess ) {
+		WelsDestroySVCEncoder( enc );
+		throw std::runtime_error( "failed to initialize h264 encoder" );
+	}
+	int format = videoFormatI420;
+	enc->SetOption( ENCODER_OPTION_DATAFORMAT, &format );
+	VLOG( 1 ) << "h264 stream " << pic_width << "x" << pic_height
+			  << " at " << bitrate_kbps << "kbps";
+}
+
+H264Encoder::~H264Encoder()
+{
+	enc->Uninitialize();
+	WelsDestroySVCEncoder( enc );
+}
+
+void H264Encoder::encode( cufx::Image<> &frame, FrameEncodingConfig const &opts,
+						  std::vector<unsigned char> &out )
+{
+	if ( opts.bitrate_kbps != bitrate_kbps ) {
+		bitrate_kbps = opts.bitrate_kbps;
+		SBitrateInfo info;
+		info.iLayer = SPATIAL_LAYER_ALL;
+		info.iBitrate = bitrate_kbps * 1000;
+		enc->SetOption( ENCODER_OPTION_BITRATE, &info );
+	}
+	if ( opts.keyframe != keyframe ) {
+		keyframe = opts.keyframe;
+		enc->ForceIntraFrame( true );
+	}
+
+	auto y = yuv.data();
+	auto u = y + pic_width * pic_height;
+	auto v = u + pic_width * pic_height / 4;
+	rgb_to_i420( &frame.at( 0, 0 ), width, height, pic_width, pic_height, y, u, v );
+
+	SSourcePicture pic;
+	memset( &pic, 0, sizeof( pic ) );
+	pic.iColorFormat = videoFormatI420;
+	pic.iPicWidth = pic_width;
+	pic.iPicHeight = pic_height;
+	pic.iStride[ 0 ] = pic_width;
+	pic.iStride[ 1 ] = pic.iStride[ 2 ] = pic_width / 2;
+	pic.pData[ 0 ] = y;
+	pic.pData[ 1 ] = u;
+	pic.pData[ 2 ] = v;
+	pic.uiTimeStamp = timestamp;
+	timestamp += 16;
+
+	SFrameBSInfo info;
+	memset( &info, 0, sizeof( info ) );
+	out.clear();
+	if ( enc->EncodeFrame( &pic, &info ) != cmResultSuccess ) {
+		LOG( ERROR ) << "h264 encoding failed";
+		return;
+	}
+	if ( info.eFrameType == videoFrameTypeSkip ) return;
+	for ( int i = 0; i != info.iLayerNum; ++i ) {
+		auto &layer = info.sLayerInfo[ i ];
+		int len = 0;
+		for ( int j = 0; j != layer.iNalCount; ++j ) {
+			len += layer.pNalLengthInByte[ j ];
+		}
+		out.insert( out.end(), layer.pBsBuf, layer.pBsBuf + len );
+	}
+}
+
+VM_END_MODULE()
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cudafx/image.hpp>
+#include <hydrant/config.schema.hpp>
+
+class ISVCEncoder;
+
+VM_BEGIN_MODULE( hydrant )
+
+/* one openh264 stream for a fixed resolution, tuned for latency: a single
+   layer without b frames or lookahead and frames never skipped, so every
+   rendered frame yields an access unit. the stream starts with an idr,
+   later ones only come when the keyframe counter of the config moves */
+struct H264Encoder
+{
+	H264Encoder( int width, int height, FrameEncodingConfig const &opts );
+	~H264Encoder();
+
+public:
+	/* annex b nal units of the frame */
+	void encode( cufx::Image<> &frame, FrameEncodingConfig const &opts,
+				 std::vector<unsigned char> &out );
+
+	int width, height;
+
+private:
+	ISVCEncoder *enc = nullptr;
+	int pic_width, pic_height;
+	std::vector<unsigned char> yuv;
+	int bitrate_kbps;
+	int keyframe;
+	long long timestamp = 0;
+};
+
+VM_END_MODULE()
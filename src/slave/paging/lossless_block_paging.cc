@@ -2,6 +2,7 @@
 #include <hydrant/bridge/buffer_3d.hpp>
 #include <hydrant/unarchiver.hpp>
 #include <hydrant/paging/lossless_block_paging.hpp>
+#include <hydrant/paging/macro_cell_registry.hpp>
 
 #define MAX_SAMPLER_COUNT ( 4096 )
 
@@ -69,6 +70,7 @@ struct LosslessBlockPagingServerImpl
 			block_storage.emplace_back( storage_opts );
 		}
 		client.lowest_blkcnt = 0;
+		macro_cells.reset( new MacroCellRegistry( client, batch_size, bs, pad, opts.device ) );
 	}
 
 	void update()
@@ -77,6 +79,7 @@ struct LosslessBlockPagingServerImpl
 			cufx::memory_transfer( device_reg_view, host_reg_view )
 			  .launch();
 		}
+		macro_cells->update();
 
 		vaddr.source( vaddr_buf.data(), false );
 		client.vaddr = vaddr.sampler();
@@ -98,6 +101,7 @@ public:
 	cufx::MemoryView1D<BlockSampler> device_reg_view;
 
 	vector<Texture3D<unsigned char>> block_storage;
+	unique_ptr<MacroCellRegistry> macro_cells;
 
 	BlockPaging client;
 };
@@ -152,6 +156,15 @@ VM_EXPORT
 			  pkt.append_to( self->buf->view_1d() );
 			  nbytes += pkt.length;
 			  if ( nbytes >= self->block_bytes ) {
+				  nbytes = 0;
+				  auto voxels = self->macro_cells->to_host( *self->buf );
+				  auto value = find_uniform_value( voxels, self->block_bytes );
+				  if ( value >= 0 ) {
+					  /* uniform blocks live in the page table only */
+					  self->vaddr_buf[ glm::vec3( idx.x, idx.y, idx.z ) ] = uniform_vaddr( value );
+					  return;
+				  }
+
 				  auto &storage = self->block_storage[ blkid ];
 				  auto fut = storage.source( self->buf->view_3d() );
 				  fut.wait();
@@ -159,9 +172,9 @@ VM_EXPORT
 				  self->host_reg_view.at( blkid ) = BlockSampler{}
 													  .set_sampler( storage.sampler() )
 													  .set_mapping( self->mapping );
+				  self->macro_cells->set( blkid, voxels );
 
 				  self->vaddr_buf[ glm::vec3( idx.x, idx.y, idx.z ) ] = blkid;
-				  nbytes = 0;
 				  blkid += 1;
 			  }
 		  } );
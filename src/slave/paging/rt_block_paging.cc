@@ -1,4 +1,8 @@
 #include <set>
+#include <map>
+#include <deque>
+#include <cstring>
+#include <iterator>
 #include <algorithm>
 #include <glog/logging.h>
 #include <hydrant/bridge/texture_3d.hpp>
@@ -6,6 +10,7 @@
 #include <hydrant/unarchiver.hpp>
 #include <hydrant/paging/unarchive_pipeline.hpp>
 #include <hydrant/paging/rt_block_paging.hpp>
+#include <hydrant/paging/macro_cell_registry.hpp>
 
 #define MAX_SAMPLER_COUNT ( 32768 )
 
@@ -81,6 +86,13 @@ public:
 
 	void unarchive_lowest_level();
 
+	/* makes a decoded block resident, idxs_mut held */
+	void insert( Idx const &idx, unsigned char const *voxels,
+				 cufx::MemoryView3D<unsigned char> const &view );
+
+	/* drops the least important redundant uniform blocks beyond the cap, idxs_mut held */
+	void evict_uniform_excess();
+
 public:
 	RtBlockPagingServerOptions opts;
 	size_t max_block_count;
@@ -92,13 +104,28 @@ public:
 	HostBuffer3D<int> basic_vaddr_buf;
 
 	unique_ptr<RtBlockPagingRegistry> registry;
+	unique_ptr<MacroCellRegistry> macro_cells;
 	unique_ptr<Unarchiver> unarchiver;
 	unique_ptr<FnUnarchivePipeline> pipeline;
 
 	vector<Idx> missing_idxs;
 	vector<Idx> redundant_idxs;
 	set<Idx> present_idxs;
-	mutex idxs_mut;
+	/* present blocks that live in the page table only, capped at max_block_count */
+	size_t uniform_count = 0;
+	/* blocks on their way from another rank, not decoded meanwhile. counted
+	   since overlapping migrations may hold the same block */
+	map<Idx, int> held_idxs;
+	mutable mutex idxs_mut;
+
+	/* host copies of decoded blocks to hand over to other ranks, oldest dropped first */
+	map<Idx, vector<unsigned char>> host_cache;
+	deque<Idx> host_cache_order;
+	size_t host_cache_count = 0;
+	size_t brick_bytes = 0;
+
+	Texture3DOptions storage_opts;
+	BlockSamplerMapping mapping;
 
 	vector<Texture3D<unsigned char>> block_storage;
 
@@ -224,11 +251,11 @@ RtBlockPagingServerImpl::RtBlockPagingServerImpl( RtBlockPagingServerOptions con
 	auto pad_bs = opts.dataset->meta.block_size + 2 * pad;
 	auto k = float( bs ) / pad_bs;
 	auto b = vec3( float( pad ) / bs * k );
-	auto mapping = BlockSamplerMapping{}.set_k( k ).set_b( b );
-	auto storage_opts = Texture3DOptions{}
-						  .set_dim( pad_bs )
-						  .set_device( opts.device )
-						  .set_opts( opts.storage_opts );
+	mapping = BlockSamplerMapping{}.set_k( k ).set_b( b );
+	storage_opts = Texture3DOptions{}
+					 .set_dim( pad_bs )
+					 .set_device( opts.device )
+					 .set_opts( opts.storage_opts );
 
 	auto mem_limit_bytes = uint64_t(opts.mem_limit_mb) * 1024 * 1024;
 	auto block_bytes = pad_bs * pad_bs * pad_bs;
@@ -240,57 +267,115 @@ RtBlockPagingServerImpl::RtBlockPagingServerImpl( RtBlockPagingServerOptions con
 	LOG( INFO ) << vm::fmt( "BLOCK_BYTES = {}", block_bytes );
 	LOG( INFO ) << vm::fmt( "MAX_BLOCK_COUNT = {}", max_block_count );
 
+	brick_bytes = block_bytes;
+	host_cache_count = opts.host_cache_mb * 1024 * 1024 / block_bytes;
+
+	/* lowest blocks keep the full range and are never leapt over */
+	macro_cells.reset( new MacroCellRegistry( client, lowest_blocks.size() + max_block_count,
+											  bs, pad, opts.device ) );
+
 	unarchiver.reset( new Unarchiver( UnarchiverOptions{}
                                     .set_path( opts.dataset->root.resolve( lvl0.path ).resolved() )
                                     .set_device( opts.device ) ) );
 	pipeline.reset(
 	  new FnUnarchivePipeline(
 		*unarchiver,
-		[&, storage_opts, mapping]( auto &idx, auto &buffer ) {
+		[&]( auto &idx, auto &buffer ) {
 			unique_lock<mutex> lk( idxs_mut );
-			int vaddr_id = -1;
 			if ( present_idxs.count( idx ) ) {
 				LOG( WARNING ) << vm::fmt( "abandoned {}", idx );
 				return;
 			}
-			if ( block_storage.size() < max_block_count ) {
-				/* skip those lowest blocks */
-				auto storage_id = block_storage.size();
-				vaddr_id = lowest_blocks.size() + storage_id;
-				// vm::println( "allocate {}", storage_id );
-				block_storage.emplace_back( storage_opts );
-			} else if ( redundant_idxs.size() ) {
-				auto swap_idx = redundant_idxs.back();
-				redundant_idxs.pop_back();
-				//				LOG( INFO ) << vm::fmt( "swap +{} -{}", idx, swap_idx );
-				present_idxs.erase( swap_idx );
-				auto uvec3_idx = uvec3( swap_idx.x, swap_idx.y, swap_idx.z );
-				auto &swap_vaddr = vaddr_buf[ uvec3_idx ];
+			insert( idx, macro_cells->to_host( buffer ), buffer.view_3d() );
+		},
+		UnarchivePipelineOptions{}
+		  .set_device( opts.device ) ) );
+}
+
+void RtBlockPagingServerImpl::insert( Idx const &idx, unsigned char const *voxels,
+									  cufx::MemoryView3D<unsigned char> const &view )
+{
+	if ( host_cache_count && !host_cache.count( idx ) ) {
+		if ( host_cache_order.size() >= host_cache_count ) {
+			host_cache.erase( host_cache_order.front() );
+			host_cache_order.pop_front();
+		}
+		host_cache[ idx ].assign( voxels, voxels + brick_bytes );
+		host_cache_order.emplace_back( idx );
+	}
+
+	int vaddr_id = -1;
+	auto value = find_uniform_value( voxels, brick_bytes );
+	if ( value >= 0 ) {
+		/* uniform blocks live in the page table only */
+		vaddr_buf[ uvec3( idx.x, idx.y, idx.z ) ] = uniform_vaddr( value );
+		present_idxs.insert( idx );
+		uniform_count += 1;
+		return;
+	}
+
+	if ( block_storage.size() < max_block_count ) {
+		/* skip those lowest blocks */
+		auto storage_id = block_storage.size();
+		vaddr_id = lowest_blocks.size() + storage_id;
+		// vm::println( "allocate {}", storage_id );
+		block_storage.emplace_back( storage_opts );
+	} else {
+		/* uniform blocks free no brick slot, keep evicting until one does */
+		while ( vaddr_id == -1 && redundant_idxs.size() ) {
+			auto swap_idx = redundant_idxs.back();
+			redundant_idxs.pop_back();
+			//				LOG( INFO ) << vm::fmt( "swap +{} -{}", idx, swap_idx );
+			present_idxs.erase( swap_idx );
+			auto uvec3_idx = uvec3( swap_idx.x, swap_idx.y, swap_idx.z );
+			auto &swap_vaddr = vaddr_buf[ uvec3_idx ];
+			if ( !is_uniform_vaddr( swap_vaddr ) ) {
 				vaddr_id = swap_vaddr;
-				/* reset that block to lowest sample level */
-				swap_vaddr = basic_vaddr_buf[ uvec3_idx ];
 			} else {
-				LOG( WARNING ) << vm::fmt( "artifact {}", idx );
-				return;
+				uniform_count -= 1;
 			}
+			/* reset that block to lowest sample level */
+			swap_vaddr = basic_vaddr_buf[ uvec3_idx ];
+		}
+		if ( vaddr_id == -1 ) {
+			LOG( WARNING ) << vm::fmt( "artifact {}", idx );
+			return;
+		}
+	}
 
-			auto storage_id = vaddr_id - lowest_blocks.size();
-			// vm::println( "at {}", storage_id );
-			auto &storage = block_storage[ storage_id ];
-			auto fut = storage.source( buffer.view_3d() );
-			fut.wait();
-			/* TODO: check whether this sampler should be updated */
-			registry->host_reg_view.at( storage_id ) = BlockSampler{}
-														 .set_sampler( storage.sampler() )
-														 .set_mapping( mapping );
-			//			  update_device_registry_if( storage_id );
-
-			vaddr_buf[ uvec3( idx.x, idx.y, idx.z ) ] = vaddr_id;
-			present_idxs.insert( idx );
-			// vm::println( "u+ {}", idx );
-		},
-		UnarchivePipelineOptions{}
-		  .set_device( opts.device ) ) );
+	auto storage_id = vaddr_id - lowest_blocks.size();
+	// vm::println( "at {}", storage_id );
+	auto &storage = block_storage[ storage_id ];
+	auto fut = storage.source( view );
+	fut.wait();
+	/* TODO: check whether this sampler should be updated */
+	registry->host_reg_view.at( storage_id ) = BlockSampler{}
+												 .set_sampler( storage.sampler() )
+												 .set_mapping( mapping );
+	//			  update_device_registry_if( storage_id );
+	macro_cells->set( vaddr_id, voxels );
+
+	vaddr_buf[ uvec3( idx.x, idx.y, idx.z ) ] = vaddr_id;
+	present_idxs.insert( idx );
+	// vm::println( "u+ {}", idx );
+}
+
+void RtBlockPagingServerImpl::evict_uniform_excess()
+{
+	if ( uniform_count <= max_block_count ) return;
+	auto excess = uniform_count - max_block_count;
+	for ( auto it = redundant_idxs.rbegin(); excess && it != redundant_idxs.rend(); ++it ) {
+		auto uvec3_idx = uvec3( it->x, it->y, it->z );
+		auto &entry = vaddr_buf[ uvec3_idx ];
+		if ( !is_uniform_vaddr( entry ) ) continue;
+		entry = basic_vaddr_buf[ uvec3_idx ];
+		present_idxs.erase( *it );
+		uniform_count -= 1;
+		excess -= 1;
+	}
+	redundant_idxs.erase( remove_if( redundant_idxs.begin(), redundant_idxs.end(),
+									 [&]( auto &idx ) { return !present_idxs.count( idx ); } ),
+						  redundant_idxs.end() );
 }
 
 void RtBlockPagingServerImpl::update( OctreeCuller &culler, Camera const &camera )
@@ -300,23 +385,33 @@ void RtBlockPagingServerImpl::update( OctreeCuller &culler, Camera const &camera
 	{
 		std::unique_lock<std::mutex> lk( idxs_mut );
 
-		missing_idxs.resize( max_block_count );
-		auto missing_idxs_end = set_difference( require_idxs.begin(), require_idxs.end(),
-												present_idxs.begin(), present_idxs.end(),
-												missing_idxs.begin() );
-		missing_idxs.resize( missing_idxs_end - missing_idxs.begin() );
+		missing_idxs.clear();
+		set_difference( require_idxs.begin(), require_idxs.end(),
+						present_idxs.begin(), present_idxs.end(),
+						back_inserter( missing_idxs ) );
+		if ( held_idxs.size() ) {
+			missing_idxs.erase( remove_if( missing_idxs.begin(), missing_idxs.end(),
+										   [&]( auto &idx ) { return held_idxs.count( idx ); } ),
+								missing_idxs.end() );
+		}
 
-		redundant_idxs.resize( max_block_count );
-		auto redundant_idxs_end = set_difference( present_idxs.begin(), present_idxs.end(),
-												  require_idxs.begin(), require_idxs.end(),
-												  redundant_idxs.begin() );
-		redundant_idxs.resize( redundant_idxs_end - redundant_idxs.begin() );
+		/* present blocks may outnumber the brick slots, uniform ones take none */
+		redundant_idxs.clear();
+		set_difference( present_idxs.begin(), present_idxs.end(),
+						require_idxs.begin(), require_idxs.end(),
+						back_inserter( redundant_idxs ) );
+		/* evictions pop from the back, so the least important block goes first */
+		std::sort( redundant_idxs.begin(), redundant_idxs.end(),
+				   [&]( auto &a, auto &b ) { return dist_fn( a ) < dist_fn( b ); } );
+		evict_uniform_excess();
 
 		if ( missing_idxs.size() ) {
 			std::sort( missing_idxs.begin(), missing_idxs.end(),
 					   [&]( auto &a,  auto &b ){ return dist_fn( a ) < dist_fn( b ); } );
 			pipeline->lock().require( missing_idxs );
 		}
+		/* the decoder thread marks and fills cells under the same lock */
+		macro_cells->update();
 	}
 
 	registry->update();
@@ -342,6 +437,59 @@ VM_EXPORT
 		return _->client;
 	}
 
+	int RtBlockPagingServer::pending_blocks() const
+	{
+		return _->missing_idxs.size();
+	}
+
+	std::size_t RtBlockPagingServer::brick_bytes() const
+	{
+		return _->brick_bytes;
+	}
+
+	bool RtBlockPagingServer::export_block( Idx const &idx, unsigned char *voxels ) const
+	{
+		std::unique_lock<std::mutex> lk( _->idxs_mut );
+		auto it = _->host_cache.find( idx );
+		if ( it == _->host_cache.end() ) return false;
+		memcpy( voxels, it->second.data(), _->brick_bytes );
+		return true;
+	}
+
+	void RtBlockPagingServer::adopt( Idx const &idx, unsigned char const *voxels )
+	{
+		std::unique_lock<std::mutex> lk( _->idxs_mut );
+		if ( _->present_idxs.count( idx ) ) return;
+		auto pad_bs = _->storage_opts.dim.x;
+		auto view = cufx::MemoryView3D<unsigned char>( const_cast<unsigned char *>( voxels ),
+													   cufx::MemoryView2DInfo{}
+														 .set_stride( pad_bs )
+														 .set_width( pad_bs )
+														 .set_height( pad_bs ),
+													   cufx::Extent{}
+														 .set_width( pad_bs )
+														 .set_height( pad_bs )
+														 .set_depth( pad_bs ) );
+		_->insert( idx, voxels, view );
+	}
+
+	void RtBlockPagingServer::hold( std::vector<Idx> const &idxs )
+	{
+		std::unique_lock<std::mutex> lk( _->idxs_mut );
+		for ( auto &idx : idxs ) { _->held_idxs[ idx ] += 1; }
+	}
+
+	void RtBlockPagingServer::release( std::vector<Idx> const &idxs )
+	{
+		std::unique_lock<std::mutex> lk( _->idxs_mut );
+		for ( auto &idx : idxs ) {
+			auto it = _->held_idxs.find( idx );
+			if ( it != _->held_idxs.end() && --it->second == 0 ) {
+				_->held_idxs.erase( it );
+			}
+		}
+	}
+
 	void RtBlockPagingServer::start()
 	{
 		_->pipeline->start();
@@ -31,11 +31,28 @@ protected:
 							   IRenderLoop &loop,
 							   OctreeCuller &culler,
 							   MpiComm const &comm,
-							   std::vector<int> const &z_order ) override;
+							   FrameSync &sync ) override;
+
+	DbufRtRenderCtx *create_dbuf_lossless_ctx() override;
+
+	std::size_t dbuf_lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+									 DbufRtRenderCtx &ctx,
+									 IRenderLoop &loop,
+									 OctreeCuller &culler,
+									 MpiComm const &comm,
+									 FrameSync &sync ) override;
+
+private:
+	LosslessBlockPagingServerOptions lossless_paging_opts() const;
+
+	void update_camera( Camera const &camera );
+
+	void update_skip_field();
 
 private:
 	std::size_t mem_limit_mb;
-	ThumbnailTexture<int> chebyshev;
+	Texture3D<int> chebyshev;
+	std::unique_ptr<IsovalueOccupancy> occupancy;
 };
 
 bool IsosurfaceRenderer::init( std::shared_ptr<Dataset> const &dataset,
@@ -50,8 +67,16 @@ bool IsosurfaceRenderer::init( std::shared_ptr<Dataset> const &dataset,
 	chebyshev_thumb.reset(
 	  new vol::Thumbnail<int>(
 		dataset->root.resolve( dataset->meta.sample_levels[ 0 ].thumbnails[ "chebyshev" ] ).resolved() ) );
-	chebyshev = create_texture( chebyshev_thumb );
-	shader.chebyshev = chebyshev.sampler();
+	value_range = ValueRangeThumbnail::load_or_build( *dataset );
+	occupancy.reset( new IsovalueOccupancy(
+	  value_range,
+	  [&]( uvec3 const &idx ) {
+		  return ( *chebyshev_thumb )[ Idx{}.set_x( idx.x ).set_y( idx.y ).set_z( idx.z ) ] == 0;
+	  } ) );
+	/* blocks missing the isovalue are culled already */
+	block_priority = make_shared<ImportancePriority>(
+	  value_range,
+	  []( vec2 const &range ) { return 1.f; } );
 
 	update( cfg.params );
 
@@ -67,6 +92,24 @@ void IsosurfaceRenderer::update( vm::json::Any const &params_in )
 	shader.mode = params.mode;
 	shader.surface_color = params.surface_color;
 	shader.isovalue = params.isovalue;
+	shader.coarse_step = std::max( params.coarse_step, 1 );
+	shader.refine_iterations = params.refine_iterations;
+	shader.smooth_normals = params.smooth_normals;
+	update_skip_field();
+}
+
+void IsosurfaceRenderer::update_skip_field()
+{
+	/* params are applied once before the thumbnails are loaded */
+	if ( !occupancy ) return;
+	/* dragging the isovalue only touches blocks with an endpoint in between */
+	if ( !occupancy->update( shader.isovalue ) ) return;
+
+	auto field = make_shared<ChebyshevField>( value_range->dim() );
+	field->rebuild( [&]( uvec3 const &idx ) { return occupancy->is_occupied( idx ); } );
+	skip_field = field;
+	chebyshev = create_texture( *skip_field );
+	shader.chebyshev = chebyshev.sampler();
 }
 
 struct IsosurfaceRenderCtx : OfflineRenderCtx
@@ -76,19 +119,23 @@ struct IsosurfaceRenderCtx : OfflineRenderCtx
 	unique_ptr<OctreeCuller> culler;
 };
 
+LosslessBlockPagingServerOptions IsosurfaceRenderer::lossless_paging_opts() const
+{
+	return LosslessBlockPagingServerOptions{}
+	  .set_dataset( dataset )
+	  .set_device( device )
+	  .set_storage_opts( cufx::Texture::Options{}
+						   .set_address_mode( cufx::Texture::AddressMode::Wrap )
+						   .set_filter_mode( cufx::Texture::FilterMode::Linear )
+						   .set_read_mode( cufx::Texture::ReadMode::NormalizedFloat )
+						   .set_normalize_coords( true ) );
+}
+
 OfflineRenderCtx *IsosurfaceRenderer::create_offline_render_ctx()
 {
 	auto ctx = new IsosurfaceRenderCtx;
 	ctx->et = inverse( exhibit.get_iet() );
-	ctx->srv.reset( new LosslessBlockPagingServer(
-	  LosslessBlockPagingServerOptions{}
-		.set_dataset( dataset )
-		.set_device( device )
-		.set_storage_opts( cufx::Texture::Options{}
-							 .set_address_mode( cufx::Texture::AddressMode::Wrap )
-							 .set_filter_mode( cufx::Texture::FilterMode::Linear )
-							 .set_read_mode( cufx::Texture::ReadMode::NormalizedFloat )
-							 .set_normalize_coords( true ) ) ) );
+	ctx->srv.reset( new LosslessBlockPagingServer( lossless_paging_opts() ) );
 	ctx->culler.reset( new OctreeCuller( exhibit, chebyshev_thumb ) );
 	return ctx;
 }
@@ -98,6 +145,7 @@ cufx::Image<> IsosurfaceRenderer::offline_render_ctxed( OfflineRenderCtx &ctx_in
 	auto &ctx = static_cast<IsosurfaceRenderCtx &>( ctx_in );
 	auto opts = RaycastingOptions{}
 				  .set_device( device );
+	ctx.culler->set_skip_field( skip_field );
 
 	auto film = create_film();
 
@@ -146,11 +194,13 @@ struct IsosurfaceRtRenderCtx : DbufRtRenderCtx
 {
 	Image<IsosurfaceShader::Pixel> film;
 	Image<IsosurfaceFetchPixel> local;
-	Image<IsosurfaceFetchPixel> recv;
-	std::unique_ptr<Image<cufx::StdByte3Pixel>> tmp;
+	std::vector<Image<IsosurfaceFetchPixel>> bands;
+	SortLastCompositor<IsosurfaceFetchPixel> compositor;
 	std::unique_ptr<RtBlockPagingServer> srv;
 
 public:
+	RtBlockPagingServer *paging_server() override { return srv.get(); }
+
 	~IsosurfaceRtRenderCtx()
 	{
 		srv->stop();
@@ -164,12 +214,11 @@ DbufRtRenderCtx *IsosurfaceRenderer::create_dbuf_rt_render_ctx()
 	ctx->local = Image<IsosurfaceFetchPixel>( ImageOptions{}
               	                              .set_device( device )
 		                                      .set_resolution( resolution ) );
-	ctx->recv = Image<IsosurfaceFetchPixel>( ImageOptions{}
-                                             .set_resolution( resolution ) );
 	auto opts = RtBlockPagingServerOptions{}
 				  .set_dim( dim )
 				  .set_dataset( dataset )
 				  .set_device( device )
+				  .set_host_cache_mb( migration_cache_mb )
 				  .set_mem_limit_mb( mem_limit_mb )
 				  .set_storage_opts( cufx::Texture::Options{}
 									   .set_address_mode( cufx::Texture::AddressMode::Wrap )
@@ -181,12 +230,43 @@ DbufRtRenderCtx *IsosurfaceRenderer::create_dbuf_rt_render_ctx()
 	return ctx;
 }
 
+/* nearest hit wins, rays that missed have no closeness */
+struct IsosurfaceFetchBlend
+{
+	IsosurfaceFetchPixel operator()( IsosurfaceFetchPixel const &front, IsosurfaceFetchPixel const &back ) const
+	{
+		return back.closeness > front.closeness ? back : front;
+	}
+
+	bool empty( IsosurfaceFetchPixel const &pixel ) const
+	{
+		return pixel.closeness == 0;
+	}
+};
+
+void IsosurfaceRenderer::update_camera( Camera const &camera )
+{
+	shader.to_world = inverse( exhibit.get_iet() );
+	shader.light_pos = camera.position +
+		camera.target +
+		camera.up +
+		cross( camera.target, camera.up );
+	shader.eye_pos = camera.position;
+	/* same on every rank, so quantized depths compare across ranks */
+	auto eye = vec3( exhibit.get_iet() * vec4( camera.position, 1.f ) );
+	shader.depth_far = 0.f;
+	for ( int i = 0; i != 8; ++i ) {
+		auto corner = vec3( i & 1, i >> 1 & 1, i >> 2 & 1 ) * exhibit.size;
+		shader.depth_far = std::max( shader.depth_far, distance( eye, corner ) );
+	}
+}
+
 std::size_t IsosurfaceRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &frame,
 											   DbufRtRenderCtx &ctx_in,
 											   IRenderLoop &loop,
 											   OctreeCuller &culler,
 											   MpiComm const &comm,
-											   std::vector<int> const &z_order )
+											   FrameSync &sync )
 {
 	auto &ctx = static_cast<IsosurfaceRtRenderCtx &>( ctx_in );
 
@@ -194,21 +274,24 @@ std::size_t IsosurfaceRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel>
 	
 	std::size_t ns0, ns1, ns2;
 
-	shader.to_world = inverse( exhibit.get_iet() );
-	shader.light_pos = loop.camera.position +
-		loop.camera.target +
-		loop.camera.up +
-		cross( loop.camera.target, loop.camera.up );
-	shader.eye_pos = loop.camera.position;
+	update_camera( loop.camera );
 	shader.paging = ctx.srv->update( culler, loop.camera );
 	
-	if ( !ctx.tmp ) {
-		ctx.tmp.reset( new Image<cufx::StdByte3Pixel>( ImageOptions{}
-		                                    .set_resolution( resolution.x,
-															 resolution.y / comm.size ) ) );
+	auto convert = []( IsosurfaceFetchPixel const &pixel ) { return pixel.val; };
+
+	if ( tiles ) {
+		return tile_render_frame( frame, ctx.film, ctx.bands, loop, convert );
 	}
 
-	auto opts = RaycastingOptions{}.set_device( device );
+	if ( compositing.streaming ) {
+		render_t = stream_render_frame( frame, ctx.film, ctx.local, ctx.bands, ctx.compositor,
+										loop, comm, sync, IsosurfaceFetchBlend{}, convert );
+		return render_t;
+	}
+
+	auto opts = RaycastingOptions{}
+				  .set_device( device )
+				  .set_viewport( viewport );
 	{
 		vm::Timer::Scoped timer( [&]( auto dt ) {
 				render_t = dt.ns().cnt();
@@ -232,6 +315,7 @@ std::size_t IsosurfaceRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel>
 				ns1 = dt.ns().cnt();
 			} );
 		ctx.local.fetch_data();
+		clear_outside( ctx.local.view(), viewport );
 	}
 
 	vm::Timer::Scoped timer( [&]( auto dt ) {
@@ -246,68 +330,50 @@ std::size_t IsosurfaceRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel>
 		});
 
 	auto local_view = ctx.local.view();
-	auto recv_view = ctx.recv.view();
-	auto s_height = ctx.recv.view().height() / comm.size;
-	auto s_bytes = ctx.recv.bytes() / recv_view.height() * s_height;
-
-	std::vector<MPI_Request> rs( comm.size * 2 );
-	for ( int i = 0; i < comm.size; ++i ) {
-		if ( i != comm.rank ) {
-			MPI_Isend( &local_view.at_host( 0, i * s_height ), s_bytes,
-					   MPI_CHAR, i, 0, comm.comm, &rs[ i ] );
-			MPI_Irecv( &recv_view.at_host( 0, i * s_height ), s_bytes,
-					   MPI_CHAR, i, 0, comm.comm, &rs[ i + comm.size ] );
-		} else {
-			memcpy( &recv_view.at_host( 0, i * s_height ),
-					&local_view.at_host( 0, i * s_height ), s_bytes );
-		}
-	}
-	for ( int i = 0; i < comm.size; ++i ) {
-		if ( i != comm.rank ) {
-			MPI_Wait( &rs[ i ], MPI_STATUS_IGNORE );
-			MPI_Wait( &rs[ i + comm.size ], MPI_STATUS_IGNORE );
-		}
-	}
-	
-	auto f0 = z_order[ 0 ] * s_height;
-	for ( int k = 1; k < comm.size; ++k ) {
-		auto f1 = z_order[ k ] * s_height;
-		for ( int j = 0; j < s_height; ++j ) {
-			for ( int i = 0; i < recv_view.width(); ++i ) {
-				auto &front = recv_view.at_host( i, j + f0 );
-				auto &back = recv_view.at_host( i, j + f1 );
-				if ( back.depth < front.depth ) { front = back; }
-			}
-		}
-	}
-	auto tmp_view = ctx.tmp->view();
-	for ( int j = 0; j < s_height; ++j ) {
-		for ( int i = 0; i < recv_view.width(); ++i ) {
-			auto &val = recv_view.at_host( i, j + f0 ).val;
-			reinterpret_cast<uchar3&>( tmp_view.at_host( i, j ) ) =
-				uchar3{ val.x, val.y, val.z };
-		}
-	}
-
 	auto frame_view = frame.view();
-	auto t_bytes = ctx.tmp->bytes();
-	for ( int i = 1; i < comm.size; ++i ) {
-		if ( comm.rank == 0 ) {
-			MPI_Recv( &frame_view.at_host( 0, i * s_height ), t_bytes,
-					  MPI_CHAR, i, 0, comm.comm, MPI_STATUS_IGNORE );
-		} else if ( i == comm.rank ) {
-			MPI_Send( &tmp_view.at_host( 0, 0 ), t_bytes,
-					  MPI_CHAR, 0, 0, comm.comm );
-		}
-	}
-	if ( comm.rank == 0 ) {
-		memcpy( &frame_view.at_host( 0, 0 ),
-				&tmp_view.at_host( 0, 0 ), t_bytes );
-	}
-
-	MPI_Barrier( comm.comm );
+	auto &z_order = sync.z_order();
+	ctx.compositor.composite(
+	  local_view, frame_view, comm, z_order, compositing,
+	  IsosurfaceFetchBlend{}, convert );
 
 	return render_t;
 }
 
+struct IsosurfaceLosslessCtx : DbufRtRenderCtx
+{
+	mat4 et;
+	Image<IsosurfaceShader::Pixel> film;
+	Image<IsosurfaceFetchPixel> local;
+	SortLastCompositor<IsosurfaceFetchPixel> compositor;
+	unique_ptr<LosslessBlockPagingServer> srv;
+};
+
+DbufRtRenderCtx *IsosurfaceRenderer::create_dbuf_lossless_ctx()
+{
+	auto ctx = new IsosurfaceLosslessCtx;
+	ctx->et = inverse( exhibit.get_iet() );
+	ctx->film = create_film();
+	ctx->local = Image<IsosurfaceFetchPixel>( ImageOptions{}
+											  .set_device( device )
+											  .set_resolution( resolution ) );
+	ctx->srv.reset( new LosslessBlockPagingServer( lossless_paging_opts() ) );
+	return ctx;
+}
+
+std::size_t IsosurfaceRenderer::dbuf_lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+													 DbufRtRenderCtx &ctx_in,
+													 IRenderLoop &loop,
+													 OctreeCuller &culler,
+													 MpiComm const &comm,
+													 FrameSync &sync )
+{
+	auto &ctx = static_cast<IsosurfaceLosslessCtx &>( ctx_in );
+
+	update_camera( loop.camera );
+	return lossless_render_frame(
+	  frame, *ctx.srv, ctx.et, ctx.film, ctx.local, ctx.compositor,
+	  loop, culler, comm, sync, IsosurfaceFetchBlend{},
+	  []( IsosurfaceFetchPixel const &pixel ) { return pixel.val; } );
+}
+
 REGISTER_RENDERER( IsosurfaceRenderer, "Isosurface" );
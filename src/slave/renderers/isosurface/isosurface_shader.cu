@@ -13,15 +13,6 @@ struct IsosurfaceShaderKernel : IsosurfaceShader
 		return (int)di;
 	}
 
-	/* central difference */
-	__host__ __device__ vec3
-	  gradient( BlockSampler const &s, vec3 p, float dt ) const
-	{
-		return vec3( s.sample_3d<float>( p - vec3( dt, 0, 0 ) ) - s.sample_3d<float>( p + vec3( dt, 0, 0 ) ),
-					 s.sample_3d<float>( p - vec3( 0, dt, 0 ) ) - s.sample_3d<float>( p + vec3( 0, dt, 0 ) ),
-					 s.sample_3d<float>( p - vec3( 0, 0, dt ) ) - s.sample_3d<float>( p + vec3( 0, 0, dt ) ) );
-	}
-
 	__host__ __device__ float
 	  linear_to_srgb( float linear ) const
 	{
@@ -36,6 +27,8 @@ struct IsosurfaceShaderKernel : IsosurfaceShader
 	{
 		pixel_out.origin = ray.o;
 		pixel_out.depth = INFINITY;
+		/* rays enter from outside the surface */
+		pixel_out.prev_value = 0.f;
 	}
 
 	__host__ __device__ void
@@ -44,7 +37,127 @@ struct IsosurfaceShaderKernel : IsosurfaceShader
 		auto pixel_out = reinterpret_cast<IsosurfaceFetchPixel *>( pixel_out_ );
 		auto val = saturate( pixel_in.v );
 		pixel_out->val = uchar3{ val.x, val.y, val.z };
-		pixel_out->depth = pixel_in.depth;
+		pixel_out->closeness = pixel_in.depth == INFINITY ? 0 :
+		  65535 - (unsigned short)min( pixel_in.depth / depth_far * 65534.f + .5f, 65534.f );
+	}
+
+	__host__ __device__ BlockSampler const *
+	  block_at( vec3 const &p, vec3 &ip ) const
+	{
+		ip = floor( p );
+		auto pgid = paging.vaddr.sample_3d<int>( ip );
+		return pgid < 0 ? nullptr : &paging.block_sampler[ pgid ];
+	}
+
+	__host__ __device__ bool
+	  sample_at( vec3 const &p, float &value ) const
+	{
+		vec3 ip = floor( p );
+		auto pgid = paging.vaddr.sample_3d<int>( ip );
+		if ( pgid == -1 ) return false;
+		value = is_uniform_vaddr( pgid ) ? uniform_vaddr_value( pgid )
+										 : paging.block_sampler[ pgid ].sample_3d<float>( p - ip );
+		return true;
+	}
+
+	/* safeguarded secant search on a bracketing interval [ p0, p1 ] */
+	__host__ __device__ vec3
+	  refine_hit( vec3 p0, float v0, vec3 p1, float v1 ) const
+	{
+		for ( int i = 0; i < refine_iterations; ++i ) {
+			/* keep away from the endpoints so a flat side cannot stall the search */
+			auto a = clamp( ( isovalue - v0 ) / ( v1 - v0 ), .05f, .95f );
+			auto p = mix( p0, p1, a );
+			float v;
+			if ( !sample_at( p, v ) ) break;
+			if ( ( v > isovalue ) == ( v0 > isovalue ) ) {
+				p0 = p;
+				v0 = v;
+			} else {
+				p1 = p;
+				v1 = v;
+			}
+		}
+		return mix( p0, p1, ( isovalue - v0 ) / ( v1 - v0 ) );
+	}
+
+	/* shades the crossing between the previous sample and the one at p */
+	__host__ __device__ void
+	  shade_hit( Pixel &pixel, vec3 const &p, float value, float stride ) const
+	{
+		auto &d = pixel.ray.d;
+
+		pixel.v = vec4( surface_color, 1.0 );
+
+		/* the crossing lies within the last stride */
+		auto prev_p = p - stride * d;
+		vec3 inter_p = refine_hit( prev_p, pixel.prev_value, p, value );
+		/* uniform blocks have no gradient, take it from the brick on either side */
+		vec3 hit_ip;
+		auto hit_sampler = block_at( inter_p, hit_ip );
+		if ( !hit_sampler ) { hit_sampler = block_at( p, hit_ip ); }
+		if ( !hit_sampler ) { hit_sampler = block_at( prev_p, hit_ip ); }
+		/* TODO: sample at different dt for each axis to avoid having undo scaling */
+		vec3 nn = -d;
+		if ( hit_sampler ) {
+			vec3 grad;
+			hit_sampler->sample_3d_grad<float>( inter_p - hit_ip, grad, du * 2.f, smooth_normals );
+			nn = -grad;
+		}
+
+		/* TODO: can we optimize somehow? */
+		vec3 world_p = vec3( to_world * vec4( inter_p, 1.f ) );
+		vec3 n = normalize( vec3( to_world * vec4( nn, 0.f ) ) );
+		vec3 light_dir = normalize( light_pos - world_p );
+		vec3 h = normalize( light_dir - world_p ); /* eye is at origin */
+
+		const float ambient = 0.2;
+		float diffuse = .6f * clamp( dot( light_dir, n ), 0.f, 1.f );
+		float specular = .2f * pow( clamp( dot( h, n ), 0.f, 1.f ), 100.f );
+		float distance = length( world_p - eye_pos ) / 2.f;
+
+		switch ( mode._to_integral() ) {
+		case IsosurfaceRenderMode::Color: {
+			pixel.v = pixel.v * ( ambient + ( diffuse + specular ) / distance );
+			pixel.v = vec4( linear_to_srgb( pixel.v.r ),
+							linear_to_srgb( pixel.v.g ),
+							linear_to_srgb( pixel.v.b ),
+							pixel.v.a );
+		} break;
+		case IsosurfaceRenderMode::Position: {
+			pixel.v = vec4( inter_p / bbox.max, 1 );
+		} break;
+		case IsosurfaceRenderMode::Normal: {
+			pixel.v = vec4( n, 1 );
+		} break;
+		}
+
+		pixel.depth = glm::distance( inter_p, pixel.origin );
+		pixel.nsteps = 0;
+	}
+
+	__host__ __device__ bool
+	  crosses( float prev_value, float value ) const
+	{
+		return prev_value >= 0.f && ( value > isovalue ) != ( prev_value > isovalue );
+	}
+
+	/* a cell on the same side as the previous sample holds no crossing. side
+	   is the value the ray carries past it, so the next sample compares
+	   against the skipped cell and not a sample from before it */
+	__host__ __device__ bool
+	  skip_cell( MacroCell const &cell, float prev_value, float &side ) const
+	{
+		auto lo = cell.min / 255.f, hi = cell.max / 255.f;
+		if ( hi <= isovalue && !( prev_value > isovalue ) ) {
+			side = hi;
+			return true;
+		}
+		if ( lo > isovalue && ( prev_value < 0.f || prev_value > isovalue ) ) {
+			side = lo;
+			return true;
+		}
+		return false;
 	}
 
 	__host__ __device__ void
@@ -53,73 +166,94 @@ struct IsosurfaceShaderKernel : IsosurfaceShader
 		auto pixel = pixel_in_out;
 		auto &ray = pixel.ray;
 		auto &nsteps = pixel.nsteps;
+		/* negative when the side of the previous sample is unknown */
+		auto &prev_value = pixel.prev_value;
 
 		const auto cdu = 1.f / compMax( abs( pixel_in_out.ray.d ) );
-		float prev_value = 0.0;
-		// pixel.v = vec4( 1 );
+		const auto stride = step * float( coarse_step );
+		/* distance back to the previous sample, fine inside straddling cells */
+		auto gap = stride;
 
 		while ( nsteps > 0 ) {
 			vec3 ip = floor( ray.o );
 			if ( int cd = chebyshev.sample_3d<int>( ip ) ) {
-				nsteps -= skip_nblock_steps( ray, ip, cd, cdu, step );
+				nsteps -= skip_nblock_steps( ray, ip, cd, cdu, stride ) * coarse_step;
+				prev_value = -1.f;
 			} else {
 				auto pgid = paging.vaddr.sample_3d<int>( ip );
-				if ( pgid != -1 ) {
-					auto &sampler = paging.block_sampler[ pgid ];
-					auto value = sampler.sample_3d<float>( ray.o - ip );
-					if ( sign( value - isovalue ) != sign( prev_value - isovalue ) ) {
-						auto &p = ray.o;
-						auto &d = ray.d;
-						auto &dt = step;
-
-						pixel.v = vec4( surface_color, 1.0 );
-
-						/* linear approximation of intersection point */
-						vec3 prev_p = p - dt * d;
-						float a = ( isovalue - prev_value ) / ( value - prev_value );
-						vec3 inter_p = ( 1.f - a ) * ( p - dt * d ) + a * p;
-						/* TODO: sample at different dt for each axis to avoid having undo scaling */
-						vec3 nn = gradient( sampler, inter_p - ip, du * 2.f );
-
-						/* TODO: can we optimize somehow? */
-						vec3 world_p = vec3( to_world * vec4( inter_p, 1.f ) );
-						vec3 n = normalize( vec3( to_world * vec4( nn, 0.f ) ) );
-						vec3 light_dir = normalize( light_pos - world_p );
-						vec3 h = normalize( light_dir - world_p ); /* eye is at origin */
-
-						const float ambient = 0.2;
-						float diffuse = .6f * clamp( dot( light_dir, n ), 0.f, 1.f );
-						float specular = .2f * pow( clamp( dot( h, n ), 0.f, 1.f ), 100.f );
-						float distance = length( world_p - eye_pos ) / 2.f;
-
-						switch ( mode._to_integral() ) {
-						case IsosurfaceRenderMode::Color: {
-							pixel.v = pixel.v * ( ambient + ( diffuse + specular ) / distance );
-							pixel.v = vec4( linear_to_srgb( pixel.v.r ),
-											linear_to_srgb( pixel.v.g ),
-											linear_to_srgb( pixel.v.b ),
-											pixel.v.a );
-						} break;
-						case IsosurfaceRenderMode::Position: {
-							pixel.v = vec4( inter_p / bbox.max, 1 );
-						} break;
-						case IsosurfaceRenderMode::Normal: {
-							pixel.v = vec4( n, 1 );
-						} break;
-						}
+				if ( pgid == -1 ) {
+					/* page fault */
+					break;
+				}
 
-						pixel.depth = glm::distance( ray.o, pixel.origin );
-						nsteps = 0;
+				auto x = ray.o - ip;
+				auto dx = ray.d * stride;
+				auto n = box_exit_steps( Ray{ x, ray.d }, Box3D{ vec3( 0 ), vec3( 1 ) }, stride );
 
+				if ( is_uniform_vaddr( pgid ) ) {
+					/* only the first sample of a uniform block can cross */
+					auto value = uniform_vaddr_value( pgid );
+					if ( crosses( prev_value, value ) ) {
+						shade_hit( pixel, ray.o, value, gap );
 						break;
 					}
-				} else {
-					/* page fault */
-					break;
+					prev_value = value;
+					ray.o += dx * float( n );
+					nsteps -= n * coarse_step;
+					gap = stride;
+					continue;
 				}
+
+				/* march the whole segment inside this block in brick local coordinates,
+				   t is the distance travelled from o */
+				auto &sampler = paging.block_sampler[ pgid ];
+				float tnear, tfar;
+				Ray{ x, ray.d }.intersect( Box3D{ vec3( 0 ), vec3( 1 ) }, tnear, tfar );
+				auto o = x;
+				float t = 0.f;
+				do {
+					auto h = stride;
+					auto cost = coarse_step;
+					auto t_end = tfar;
+					if ( paging.macro_cells ) {
+						Box3D cell_box;
+						float side;
+						if ( skip_cell( paging.macro_cell( pgid, x, cell_box ), prev_value, side ) ) {
+							/* the last stride ends inside the cell, where side holds */
+							auto k = box_exit_steps( Ray{ x, ray.d }, cell_box, stride );
+							t += k * stride;
+							x = o + ray.d * t;
+							nsteps -= k * coarse_step;
+							prev_value = side;
+							gap = stride;
+							continue;
+						}
+						/* the cell range holds the isovalue, so a thin crossing may
+						   fit between two coarse samples. march the cell finely */
+						float cnear, cfar;
+						Ray{ x, ray.d }.intersect( cell_box, cnear, cfar );
+						h = step;
+						cost = 1;
+						t_end = t + cfar;
+					}
+					do {
+						auto value = sampler.sample_3d<float>( x );
+						if ( crosses( prev_value, value ) ) {
+							shade_hit( pixel, ip + x, value, gap );
+							break;
+						}
+						prev_value = value;
+						t += h;
+						x = o + ray.d * t;
+						nsteps -= cost;
+						gap = h;
+					} while ( t < t_end && nsteps > 0 );
+				} while ( t < tfar && nsteps > 0 );
+				ray.o = ip + x;
+				continue;
 			}
-			ray.o += ray.d * step;
-			nsteps -= 1;
+			ray.o += ray.d * stride;
+			nsteps -= coarse_step;
 		}
 		pixel_in_out = pixel;
 	}
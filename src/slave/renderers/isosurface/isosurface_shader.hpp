@@ -12,12 +12,15 @@ struct IsosurfacePixel : StdVec4Pixel
 {
 	vec3 origin;
 	float depth;
+	float prev_value;
 };
 
+/* closeness is 65535 minus the depth quantized over [ 0, depth_far ] to steps
+   of depth_far / 65534, misses keep 0 so empty pixels are all zero bytes */
 struct IsosurfaceFetchPixel
 {
 	uchar3 val;
-	float depth;
+	unsigned short closeness;
 };
 
 struct IsosurfaceShader : IShader<IsosurfacePixel>
@@ -28,6 +31,11 @@ struct IsosurfaceShader : IShader<IsosurfacePixel>
 	vec3 light_pos;
 	vec3 surface_color;
 	float isovalue;
+	/* distance from the eye to the farthest corner of the volume */
+	float depth_far;
+	int coarse_step;
+	int refine_iterations;
+	bool smooth_normals;
 	Sampler chebyshev;
 	BlockPaging paging;
 };
@@ -26,7 +26,7 @@ protected:
 							   IRenderLoop &loop,
 							   OctreeCuller &culler,
 							   MpiComm const &comm,
-							   std::vector<int> const &z_order ) override;
+							   FrameSync &sync ) override;
 
 private:
 	ThumbnailTexture<int> chebyshev;
@@ -59,10 +59,13 @@ struct PagingRtRenderCtx : DbufRtRenderCtx
 {
 	Image<PagingShader::Pixel> film;
 	Image<PagingFetchPixel> local;
-	Image<PagingFetchPixel> recv;
+	std::vector<Image<PagingFetchPixel>> bands;
+	SortLastCompositor<PagingFetchPixel> compositor;
 	std::unique_ptr<RtBlockPagingServer> srv;
 
 public:
+	RtBlockPagingServer *paging_server() override { return srv.get(); }
+
 	~PagingRtRenderCtx()
 	{
 		srv->stop();
@@ -76,12 +79,11 @@ DbufRtRenderCtx *PagingRenderer::create_dbuf_rt_render_ctx()
 	ctx->local = Image<PagingFetchPixel>( ImageOptions{}
               	                              .set_device( device )
 		                                      .set_resolution( resolution ) );
-	ctx->recv = Image<PagingFetchPixel>( ImageOptions{}
-                                             .set_resolution( resolution ) );
 	auto opts = RtBlockPagingServerOptions{}
 				  .set_dim( dim )
 				  .set_dataset( dataset )
 				  .set_device( device )
+				  .set_host_cache_mb( migration_cache_mb )
 				  .set_storage_opts( cufx::Texture::Options{}
 									   .set_address_mode( cufx::Texture::AddressMode::Wrap )
 									   .set_filter_mode( cufx::Texture::FilterMode::Linear )
@@ -92,12 +94,26 @@ DbufRtRenderCtx *PagingRenderer::create_dbuf_rt_render_ctx()
 	return ctx;
 }
 
+/* any non black pixel wins */
+struct PagingFetchBlend
+{
+	PagingFetchPixel operator()( PagingFetchPixel const &front, PagingFetchPixel const &back ) const
+	{
+		return empty( front ) ? back : front;
+	}
+
+	bool empty( PagingFetchPixel const &pixel ) const
+	{
+		return pixel.val.x == 0 && pixel.val.y == 0 && pixel.val.z == 0;
+	}
+};
+
 std::size_t PagingRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &frame,
 										   DbufRtRenderCtx &ctx_in,
 										   IRenderLoop &loop,
 										   OctreeCuller &culler,
 										   MpiComm const &comm,
-										   std::vector<int> const &z_order )
+										   FrameSync &sync )
 {
 	auto &ctx = static_cast<PagingRtRenderCtx &>( ctx_in );
 
@@ -107,7 +123,21 @@ std::size_t PagingRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 	
 	shader.paging = ctx.srv->update( culler, loop.camera );
 	
-	auto opts = RaycastingOptions{}.set_device( device );
+	auto convert = []( PagingFetchPixel const &pixel ) { return pixel.val; };
+
+	if ( tiles ) {
+		return tile_render_frame( frame, ctx.film, ctx.bands, loop, convert );
+	}
+
+	if ( compositing.streaming ) {
+		render_t = stream_render_frame( frame, ctx.film, ctx.local, ctx.bands, ctx.compositor,
+										loop, comm, sync, PagingFetchBlend{}, convert );
+		return render_t;
+	}
+
+	auto opts = RaycastingOptions{}
+				  .set_device( device )
+				  .set_viewport( viewport );
 	{
 		vm::Timer::Scoped timer( [&]( auto dt ) {
 				render_t = dt.ns().cnt();
@@ -132,6 +162,7 @@ std::size_t PagingRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 				ns1 = dt.ns().cnt();
 			} );
 		ctx.local.fetch_data();
+		clear_outside( ctx.local.view(), viewport );
 	}
 
 	vm::Timer::Scoped timer( [&]( auto dt ) {
@@ -143,50 +174,13 @@ std::size_t PagingRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 			//			vm::println("render/fetch/merge = {}/{}/{}", ns0, ns1, ns2 );
 		});
 	
-	int shl = 0;
-	int flag = comm.size - 1;
-	int rank = comm.rank;
-	while ( flag ) {
-		// sender
-		if ( rank & 1 ) {
-			auto dst = ( rank & -2 ) << shl;
-			MPI_Send( &ctx.local.view().at_host( 0, 0 ), ctx.local.bytes(),
-					  MPI_CHAR, dst, 0, comm.comm );
-			break;
-		} else if ( flag != rank ) {
-			auto src = ( rank | 1 ) << shl;
-			MPI_Recv( &ctx.recv.view().at_host( 0, 0 ), ctx.recv.bytes(),
-					  MPI_CHAR, src, 0, comm.comm, MPI_STATUS_IGNORE );
-			auto local_view = ctx.local.view();
-			auto recv_view = ctx.recv.view();
-			for ( int j = 0; j != local_view.height(); ++j ) {
-				for ( int i = 0; i != local_view.width(); ++i ) {
-					auto &local = local_view.at_host( i, j );
-					auto &recv = recv_view.at_host( i, j );
-					if ( local.val.x == 0 && local.val.y == 0 && local.val.z == 0 ) {
-						local.val = recv.val;
-					}
-				}
-			}
-		}
-		shl += 1;
-		flag >>= 1;
-		rank >>= 1;
-	}
-	
-	if ( comm.rank == 0 ) {
-		auto local_view = ctx.local.view();
-		auto frame_view = frame.view();
-		for ( int j = 0; j != local_view.height(); ++j ) {
-			for ( int i = 0; i != local_view.width(); ++i ) {
-				reinterpret_cast<uchar3&>( frame_view.at_host( i, j ) ) =
-					local_view.at_host( i, j ).val;
-			}
-		}
-	}
+	auto local_view = ctx.local.view();
+	auto frame_view = frame.view();
+	auto &z_order = sync.z_order();
+	ctx.compositor.composite(
+	  local_view, frame_view, comm, z_order, compositing,
+	  PagingFetchBlend{}, convert );
 	
-	MPI_Barrier( comm.comm );
-
 	return render_t;
 }
 
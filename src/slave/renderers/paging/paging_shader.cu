@@ -39,7 +39,7 @@ struct PagingShaderKernel : PagingShader
 				auto pgid = paging.vaddr.sample_3d<int>( ip );
 				if ( pgid != -1 ) {
 					vec4 col;
-					if ( pgid >= paging.lowest_blkcnt ) {
+					if ( pgid >= paging.lowest_blkcnt || is_uniform_vaddr( pgid ) ) {
 						col = vec4( 0, 1, 0, 1 ) * .5f;
 					} else {
 						col = vec4( 1, 0, 0, 1 ) * .2f;
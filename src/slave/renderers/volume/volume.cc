@@ -1,8 +1,12 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <VMUtils/timer.hpp>
 #include <hydrant/dbuf_renderer.hpp>
 #include <hydrant/paging/rt_block_paging.hpp>
 #include <hydrant/paging/lossless_block_paging.hpp>
 #include <hydrant/transfer_fn.hpp>
+#include <hydrant/srgb_lut.hpp>
 #include "volume_shader.hpp"
 
 using namespace std;
@@ -31,12 +35,31 @@ protected:
 							   IRenderLoop &loop,
 							   OctreeCuller &culler,
 							   MpiComm const &comm,
-							   std::vector<int> const &z_order ) override;
+							   FrameSync &sync ) override;
+
+	DbufRtRenderCtx *create_dbuf_lossless_ctx() override;
+
+	std::size_t dbuf_lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+									 DbufRtRenderCtx &ctx,
+									 IRenderLoop &loop,
+									 OctreeCuller &culler,
+									 MpiComm const &comm,
+									 FrameSync &sync ) override;
+
+private:
+	LosslessBlockPagingServerOptions lossless_paging_opts() const;
+
+	void update_skip_field();
+
+	void update_tf_tables( bool preintegrate, bool tf_changed );
 
 private:
 	std::size_t mem_limit_mb;
 	TransferFn transfer_fn;
-	ThumbnailTexture<int> chebyshev;
+	Texture3D<int> chebyshev;
+	float lut_ratio = 0.f;
+	float preint_ratio = 0.f;
+	Texture3D<vec4> preint_table;
 };
 
 bool VolumeRenderer::init( std::shared_ptr<Dataset> const &dataset,
@@ -47,10 +70,13 @@ bool VolumeRenderer::init( std::shared_ptr<Dataset> const &dataset,
 	chebyshev_thumb.reset(
 	  new vol::Thumbnail<int>(
 		dataset->root.resolve( dataset->meta.sample_levels[ 0 ].thumbnails[ "chebyshev" ] ).resolved() ) );
-	chebyshev = create_texture( chebyshev_thumb );
-	shader.chebyshev = chebyshev.sampler();
+	value_range = ValueRangeThumbnail::load_or_build( *dataset );
+	block_priority = make_shared<ImportancePriority>(
+	  value_range,
+	  [this]( vec2 const &range ) { return transfer_fn.max_opacity( range.x, range.y ); } );
 
 	update( cfg.params );
+	if ( !skip_field ) { update_skip_field(); }
 
 	return true;
 }
@@ -62,10 +88,68 @@ void VolumeRenderer::update( vm::json::Any const &params_in )
 	auto params = params_in.get<VolumeRendererParams>();
 	mem_limit_mb = params.mem_limit_mb;
 	shader.mode = params.mode;
+	shader.opacity_threshold = params.opacity_threshold;
+	shader.adaptive = params.adaptive_sampling;
+	shader.refine_threshold = params.refine_threshold;
+	shader.max_step_size = std::max( params.max_step_size, 1 );
 	if ( params.transfer_fn.values.size() ) {
 		transfer_fn = TransferFn( params.transfer_fn, device );
 		shader.transfer_fn = transfer_fn.sampler();
+		shader.tf_opaque_prefix = transfer_fn.opaque_prefix_sampler();
+		update_skip_field();
+	}
+	update_tf_tables( params.preintegrate, params.transfer_fn.values.size() );
+}
+
+void VolumeRenderer::update_tf_tables( bool preintegrate, bool tf_changed )
+{
+	shader.preintegrated = preintegrate && !transfer_fn.empty();
+	if ( transfer_fn.empty() ) return;
+
+	/* a step is this many steps of sample_rate 1 long, i.e. 1 / sample_rate */
+	auto ratio = shader.step / ( shader.du / 4.f );
+	if ( tf_changed || ratio != lut_ratio ) {
+		lut_ratio = ratio;
+		transfer_fn.bake_lut( ratio );
+		shader.tf_lut = transfer_fn.lut();
+		preint_ratio = 0.f;
 	}
+
+	if ( !shader.preintegrated || ratio == preint_ratio ) return;
+	preint_ratio = ratio;
+
+	vm::Timer::Scoped timer( [&]( auto dt ) {
+		LOG( INFO ) << vm::fmt( "pre-integrated transfer function built in {}ms", dt.ns().cnt() / 1000000 );
+	} );
+	/* segments are one step long, the same 1 / sample_rate as the lut */
+	auto table = transfer_fn.preintegrate( ratio );
+	preint_table = Texture3D<vec4>(
+	  Texture3DOptions{}
+		.set_device( device )
+		.set_dim( table.dim() )
+		.set_opts( cufx::Texture::Options{}
+					 .set_address_mode( cufx::Texture::AddressMode::Clamp )
+					 .set_filter_mode( cufx::Texture::FilterMode::Linear )
+					 .set_read_mode( cufx::Texture::ReadMode::Raw )
+					 .set_normalize_coords( true ) ) );
+	preint_table.source( table.data() );
+	shader.preint_table = preint_table.sampler();
+}
+
+void VolumeRenderer::update_skip_field()
+{
+	/* params are applied once before the thumbnails are loaded */
+	if ( !value_range ) return;
+
+	auto field = make_shared<ChebyshevField>( value_range->dim() );
+	field->rebuild( [&]( uvec3 const &idx ) {
+		auto &range = ( *value_range )[ idx ];
+		return ( *chebyshev_thumb )[ Idx{}.set_x( idx.x ).set_y( idx.y ).set_z( idx.z ) ] == 0 &&
+			   !transfer_fn.is_transparent( range.x, range.y );
+	} );
+	skip_field = field;
+	chebyshev = create_texture( *skip_field );
+	shader.chebyshev = chebyshev.sampler();
 }
 
 struct VolumeOfflineRenderCtx : OfflineRenderCtx
@@ -75,19 +159,23 @@ struct VolumeOfflineRenderCtx : OfflineRenderCtx
 	unique_ptr<OctreeCuller> culler;
 };
 
+LosslessBlockPagingServerOptions VolumeRenderer::lossless_paging_opts() const
+{
+	return LosslessBlockPagingServerOptions{}
+	  .set_dataset( dataset )
+	  .set_device( device )
+	  .set_storage_opts( cufx::Texture::Options{}
+						   .set_address_mode( cufx::Texture::AddressMode::Wrap )
+						   .set_filter_mode( cufx::Texture::FilterMode::Linear )
+						   .set_read_mode( cufx::Texture::ReadMode::NormalizedFloat )
+						   .set_normalize_coords( true ) );
+}
+
 OfflineRenderCtx *VolumeRenderer::create_offline_render_ctx()
 {
 	auto ctx = new VolumeOfflineRenderCtx;
 	ctx->et = inverse( exhibit.get_iet() );
-	ctx->srv.reset( new LosslessBlockPagingServer(
-	  LosslessBlockPagingServerOptions{}
-		.set_dataset( dataset )
-		.set_device( device )
-		.set_storage_opts( cufx::Texture::Options{}
-							 .set_address_mode( cufx::Texture::AddressMode::Wrap )
-							 .set_filter_mode( cufx::Texture::FilterMode::Linear )
-							 .set_read_mode( cufx::Texture::ReadMode::NormalizedFloat )
-							 .set_normalize_coords( true ) ) ) );
+	ctx->srv.reset( new LosslessBlockPagingServer( lossless_paging_opts() ) );
 	ctx->culler.reset( new OctreeCuller( exhibit, chebyshev_thumb ) );
 	return ctx;
 }
@@ -97,6 +185,7 @@ cufx::Image<> VolumeRenderer::offline_render_ctxed( OfflineRenderCtx &ctx_in, Ca
 	auto &ctx = static_cast<VolumeOfflineRenderCtx &>( ctx_in );
 	auto opts = RaycastingOptions{}
 				  .set_device( device );
+	ctx.culler->set_skip_field( skip_field );
 
 	auto film = create_film();
 
@@ -137,11 +226,13 @@ struct VolumeRtRenderCtx : DbufRtRenderCtx
 {
 	Image<VolumeShader::Pixel> film;
 	Image<VolumeFetchPixel> local;
-	Image<VolumeFetchPixel> recv;
-	std::unique_ptr<Image<cufx::StdByte3Pixel>> tmp;
+	std::vector<Image<VolumeFetchPixel>> bands;
+	SortLastCompositor<VolumeFetchPixel> compositor;
 	std::unique_ptr<RtBlockPagingServer> srv;
 
 public:
+	RtBlockPagingServer *paging_server() override { return srv.get(); }
+
 	~VolumeRtRenderCtx()
 	{
 		srv->stop();
@@ -155,12 +246,11 @@ DbufRtRenderCtx *VolumeRenderer::create_dbuf_rt_render_ctx()
 	ctx->local = Image<VolumeFetchPixel>( ImageOptions{}
                                           .set_device( device )
 		                                  .set_resolution( resolution ) );
-	ctx->recv = Image<VolumeFetchPixel>( ImageOptions{}
-		                                  .set_resolution( resolution ) );
 	auto opts = RtBlockPagingServerOptions{}
 				  .set_dim( dim )
 				  .set_dataset( dataset )
 				  .set_device( device )
+				  .set_host_cache_mb( migration_cache_mb )
 				  .set_mem_limit_mb( mem_limit_mb )
 				  .set_storage_opts( cufx::Texture::Options{}
 									   .set_address_mode( cufx::Texture::AddressMode::Wrap )
@@ -172,20 +262,71 @@ DbufRtRenderCtx *VolumeRenderer::create_dbuf_rt_render_ctx()
 	return ctx;
 }
 
-float linear_to_srgb( float x )
+/* front to back over on normalized 16 bit premultiplied pixels, theta and
+   phi of the merged span are implied by its colour and opacity */
+struct VolumeFetchBlend
 {
-	if ( x <= 0.0031308f ) {
-		return 12.92f * x;
+	VolumeFetchPixel operator()( VolumeFetchPixel const &front, VolumeFetchPixel const &back ) const
+	{
+		auto k = 1.f - front.val.w / 65535.f;
+		auto over = [k]( unsigned short f, unsigned short b ) {
+			return (unsigned short)std::min( f + b * k + .5f, 65535.f );
+		};
+		VolumeFetchPixel out;
+		out.val = make_ushort4( over( front.val.x, back.val.x ),
+								over( front.val.y, back.val.y ),
+								over( front.val.z, back.val.z ),
+								over( front.val.w, back.val.w ) );
+		return out;
+	}
+
+	bool empty( VolumeFetchPixel const &pixel ) const
+	{
+		return ( pixel.val.x | pixel.val.y | pixel.val.z | pixel.val.w ) == 0;
 	}
-	return 1.055f * pow( x, 1.f / 2.4f ) - 0.055f;
-}
+
+	void span( VolumeFetchPixel const *front, VolumeFetchPixel const *back,
+			   VolumeFetchPixel *dst, int n ) const
+	{
+		int i = 0;
+#ifdef __SSE2__
+		static_assert( sizeof( VolumeFetchPixel ) == 4 * sizeof( unsigned short ), "unexpected padding" );
+		/* two pixels per iteration, unpacked to float lanes and packed back
+		   with unsigned saturation, dst may alias front or back */
+		const auto zero = _mm_setzero_si128();
+		const auto one = _mm_set1_ps( 1.f );
+		const auto inv = _mm_set1_ps( 1.f / 65535.f );
+		const auto full = _mm_set1_ps( 65535.f );
+		const auto bias = _mm_set1_epi32( 32768 );
+		const auto flip = _mm_set1_epi16( short( 0x8000 ) );
+		auto over = [&]( __m128 f, __m128 b ) {
+			auto k = _mm_sub_ps( one, _mm_mul_ps( _mm_shuffle_ps( f, f, _MM_SHUFFLE( 3, 3, 3, 3 ) ), inv ) );
+			auto o = _mm_min_ps( _mm_add_ps( f, _mm_mul_ps( b, k ) ), full );
+			return _mm_sub_epi32( _mm_cvtps_epi32( o ), bias );
+		};
+		for ( ; i + 2 <= n; i += 2 ) {
+			auto f = _mm_loadu_si128( reinterpret_cast<__m128i const *>( front + i ) );
+			auto b = _mm_loadu_si128( reinterpret_cast<__m128i const *>( back + i ) );
+			auto lo = over( _mm_cvtepi32_ps( _mm_unpacklo_epi16( f, zero ) ),
+							_mm_cvtepi32_ps( _mm_unpacklo_epi16( b, zero ) ) );
+			auto hi = over( _mm_cvtepi32_ps( _mm_unpackhi_epi16( f, zero ) ),
+							_mm_cvtepi32_ps( _mm_unpackhi_epi16( b, zero ) ) );
+			auto o = _mm_xor_si128( _mm_packs_epi32( lo, hi ), flip );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), o );
+		}
+#endif
+		for ( ; i < n; ++i ) {
+			dst[ i ] = ( *this )( front[ i ], back[ i ] );
+		}
+	}
+};
 
 std::size_t VolumeRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &frame,
 										   DbufRtRenderCtx &ctx_in,
 										   IRenderLoop &loop,
 										   OctreeCuller &culler,
 										   MpiComm const &comm,
-										   std::vector<int> const &z_order )
+										   FrameSync &sync )
 {
 	auto &ctx = static_cast<VolumeRtRenderCtx &>( ctx_in );
 
@@ -196,13 +337,24 @@ std::size_t VolumeRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 	shader.rank = float( comm.rank ) / ( comm.size - 1 );
 	shader.paging = ctx.srv->update( culler, loop.camera );
 
-	if ( !ctx.tmp ) {
-		ctx.tmp.reset( new Image<cufx::StdByte3Pixel>( ImageOptions{}
-		                                    .set_resolution( resolution.x,
-															 resolution.y / comm.size ) ) );
+	auto &srgb = SrgbLut::instance();
+	auto convert = [&]( VolumeFetchPixel const &pixel ) {
+		return srgb( vec3( pixel.val.x, pixel.val.y, pixel.val.z ) / 65535.f );
+	};
+
+	if ( tiles ) {
+		return tile_render_frame( frame, ctx.film, ctx.bands, loop, convert );
 	}
-	
-	auto opts = RaycastingOptions{}.set_device( device );
+
+	if ( compositing.streaming ) {
+		render_t = stream_render_frame( frame, ctx.film, ctx.local, ctx.bands, ctx.compositor,
+										loop, comm, sync, VolumeFetchBlend{}, convert );
+		return render_t;
+	}
+
+	auto opts = RaycastingOptions{}
+				  .set_device( device )
+				  .set_viewport( viewport );
 	{
 		vm::Timer::Scoped timer( [&]( auto dt ) {
 				render_t = dt.ns().cnt();
@@ -227,6 +379,7 @@ std::size_t VolumeRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 				ns1 = dt.ns().cnt();
 			} );
 		ctx.local.fetch_data();
+		clear_outside( ctx.local.view(), viewport );
 	}
 
 	vm::Timer::Scoped timer( [&]( auto dt ) {
@@ -241,75 +394,54 @@ std::size_t VolumeRenderer::dbuf_rt_render_frame( Image<cufx::StdByte3Pixel> &fr
 		} );
 
 	auto local_view = ctx.local.view();
-	auto recv_view = ctx.recv.view();
-	auto s_height = ctx.recv.view().height() / comm.size;
-	auto s_bytes = ctx.recv.bytes() / recv_view.height() * s_height;
-
-	std::vector<MPI_Request> rs( comm.size * 2 );
-	for ( int i = 0; i < comm.size; ++i ) {
-		if ( i != comm.rank ) {
-			MPI_Isend( &local_view.at_host( 0, i * s_height ), s_bytes,
-					   MPI_CHAR, i, 0, comm.comm, &rs[ i ] );
-			MPI_Irecv( &recv_view.at_host( 0, i * s_height ), s_bytes,
-					   MPI_CHAR, i, 0, comm.comm, &rs[ i + comm.size ] );
-		} else {
-			memcpy( &recv_view.at_host( 0, i * s_height ),
-					&local_view.at_host( 0, i * s_height ), s_bytes );
-		}
-	}
-	for ( int i = 0; i < comm.size; ++i ) {
-		if ( i != comm.rank ) {
-			MPI_Wait( &rs[ i ], MPI_STATUS_IGNORE );
-			MPI_Wait( &rs[ i + comm.size ], MPI_STATUS_IGNORE );
-		}
-	}
-	
-	auto f0 = z_order[ 0 ] * s_height;		
-	for ( int k = 1; k < comm.size; ++k ) {
-		auto f1 = z_order[ k ] * s_height;
-		for ( int j = 0; j < s_height; ++j ) {
-			for ( int i = 0; i < recv_view.width(); ++i ) {
-				auto &front = recv_view.at_host( i, j + f0 );
-				auto &back = recv_view.at_host( i, j + f1 );
-				auto v_n = vec3( front.val ) + vec3( back.val ) -
-					front.val.w * back.theta;
-				auto a_n = back.phi * front.val.w + back.val.w;
-				front.val = vec4( v_n.x, v_n.y, v_n.z, a_n );
-			}
-		}
-	}
-	auto tmp_view = ctx.tmp->view();
-	for ( int j = 0; j < s_height; ++j ) {
-		for ( int i = 0; i < recv_view.width(); ++i ) {
-			auto &v = recv_view.at_host( i, j + f0 ).val;
-			v.x = linear_to_srgb( v.x );
-			v.y = linear_to_srgb( v.y );
-			v.z = linear_to_srgb( v.z );
-			auto val = saturate( v );
-			reinterpret_cast<uchar3&>( tmp_view.at_host( i, j ) ) =
-				uchar3{ val.x, val.y, val.z };
-		}
-	}
-
 	auto frame_view = frame.view();
-	auto t_bytes = ctx.tmp->bytes();
-	for ( int i = 1; i < comm.size; ++i ) {
-		if ( comm.rank == 0 ) {
-			MPI_Recv( &frame_view.at_host( 0, i * s_height ), t_bytes,
-					  MPI_CHAR, i, 0, comm.comm, MPI_STATUS_IGNORE );
-		} else if ( i == comm.rank ) {
-			MPI_Send( &tmp_view.at_host( 0, 0 ), t_bytes,
-					  MPI_CHAR, 0, 0, comm.comm );
-		}
-	}
-	if ( comm.rank == 0 ) {
-		memcpy( &frame_view.at_host( 0, 0 ),
-				&tmp_view.at_host( 0, 0 ), t_bytes );
-	}
-
-	MPI_Barrier( comm.comm );
+	auto &z_order = sync.z_order();
+	ctx.compositor.composite(
+	  local_view, frame_view, comm, z_order, compositing,
+	  VolumeFetchBlend{}, convert );
 
 	return render_t;
 }
 
+struct VolumeLosslessCtx : DbufRtRenderCtx
+{
+	mat4 et;
+	Image<VolumeShader::Pixel> film;
+	Image<VolumeFetchPixel> local;
+	SortLastCompositor<VolumeFetchPixel> compositor;
+	unique_ptr<LosslessBlockPagingServer> srv;
+};
+
+DbufRtRenderCtx *VolumeRenderer::create_dbuf_lossless_ctx()
+{
+	auto ctx = new VolumeLosslessCtx;
+	ctx->et = inverse( exhibit.get_iet() );
+	ctx->film = create_film();
+	ctx->local = Image<VolumeFetchPixel>( ImageOptions{}
+										  .set_device( device )
+										  .set_resolution( resolution ) );
+	ctx->srv.reset( new LosslessBlockPagingServer( lossless_paging_opts() ) );
+	return ctx;
+}
+
+std::size_t VolumeRenderer::dbuf_lossless_render_frame( Image<cufx::StdByte3Pixel> &frame,
+												 DbufRtRenderCtx &ctx_in,
+												 IRenderLoop &loop,
+												 OctreeCuller &culler,
+												 MpiComm const &comm,
+												 FrameSync &sync )
+{
+	auto &ctx = static_cast<VolumeLosslessCtx &>( ctx_in );
+
+	shader.rank = float( comm.rank ) / ( comm.size - 1 );
+
+	auto &srgb = SrgbLut::instance();
+	return lossless_render_frame(
+	  frame, *ctx.srv, ctx.et, ctx.film, ctx.local, ctx.compositor,
+	  loop, culler, comm, sync, VolumeFetchBlend{},
+	  [&]( VolumeFetchPixel const &pixel ) {
+		  return srgb( vec3( pixel.val.x, pixel.val.y, pixel.val.z ) / 65535.f );
+	  } );
+}
+
 REGISTER_RENDERER( VolumeRenderer, "Volume" );
@@ -13,27 +13,81 @@ struct VolumeShaderKernel : VolumeShader
 		return (int)di;
 	}
 
+	/* whether every value in the macro cell is transparent under the transfer function */
+	__host__ __device__ bool
+	  is_transparent( MacroCell const &cell ) const
+	{
+		return tf_opaque_prefix.sample_1d<float>( cell.max + 1.5f ) ==
+			   tf_opaque_prefix.sample_1d<float>( cell.min + .5f );
+	}
+
+	/* corrects a premultiplied sample of one step to a stride of k steps */
+	__host__ __device__ vec4
+	  correct_opacity( vec4 const &ub, int k ) const
+	{
+		if ( k == 1 || ub.w <= 0.f ) return ub;
+		auto a = 1.f - pow( 1.f - min( ub.w, .9999f ), float( k ) );
+		return ub * ( a / ub.w );
+	}
+
+	/* refines the stride where samples change fast, coarsens it where they do not */
+	__host__ __device__ int
+	  adapt_step_size( int step_size, float s_prev, float s_i ) const
+	{
+		if ( !adaptive || s_prev < 0.f ) return step_size;
+		auto ds = abs( s_i - s_prev );
+		if ( ds > refine_threshold ) {
+			return max( step_size / 2, 1 );
+		} else if ( ds < refine_threshold / 4.f ) {
+			return min( step_size * 2, max_step_size );
+		}
+		return step_size;
+	}
+
+	/* premultiplied sample of a single step */
+	__host__ __device__ vec4
+	  classify( float s_i, bool hires ) const
+	{
+		if ( mode == VolumeRenderMode::Default ) { return tf_lut.sample( s_i ); }
+		auto ub_i = transfer_fn.sample_1d<vec4>( s_i );
+		if ( mode == VolumeRenderMode::Partition ) {
+		    vec3 lower = { 1, 0, 0 };
+		    vec3 upper = { 0, 0, 1 };
+			auto v = mix( lower, upper, rank ) *
+				       float( length( vec3( ub_i ) ) );
+			ub_i = vec4( v.x, v.y, v.z, ub_i.w );
+		} else if ( mode == VolumeRenderMode::Paging ) {
+			if ( hires ) {
+				ub_i = vec4( 0, 1, 0, ub_i.w );
+			} else {
+				ub_i = vec4( 1, 0, 0, ub_i.w );
+			}
+		}
+		return ub_i * vec4( ub_i.w, ub_i.w, ub_i.w, 1 );
+	}
+
 	__host__ __device__ void
 	  init( Pixel &pixel_out, Ray const &ray ) const
 	{
 		pixel_out.theta = vec3( 0 );
 		pixel_out.phi = 1.f;
+		pixel_out.s_prev = -1.f;
 	}
 
 	__host__ __device__ void
 	  fetch( Pixel const &pixel_in, void *pixel_out_ ) const
 	{
 		auto pixel_out = reinterpret_cast<VolumeFetchPixel *>( pixel_out_ );
-		pixel_out->val = pixel_in.v;
-		pixel_out->theta = pixel_in.theta;
-		pixel_out->phi = pixel_in.phi;
+		pixel_out->val = make_ushort4( to_unorm16( pixel_in.v.x ),
+									   to_unorm16( pixel_in.v.y ),
+									   to_unorm16( pixel_in.v.z ),
+									   to_unorm16( pixel_in.v.w ) );
 	}
 
 	__host__ __device__ void
 	  main( Pixel &pixel_in_out ) const
 	{
 		const auto cdu = 1.f / compMax( abs( pixel_in_out.ray.d ) );
-		// const auto opacity_threshold = 0.999f;
 
 		auto pixel = pixel_in_out;
 		auto &ray = pixel.ray;
@@ -44,35 +98,83 @@ struct VolumeShaderKernel : VolumeShader
 			vec3 ip = floor( ray.o );
 			if ( int cd = chebyshev.sample_3d<int>( ip ) ) {
 			    // skip_block.b_i = 0
-				nsteps -= skip_nblock_steps( ray, ip, cd, cdu, step * step_size );
+				nsteps -= skip_nblock_steps( ray, ip, cd, cdu, step * step_size ) * step_size;
+				pixel.s_prev = -1.f;
 			} else {
 				auto pgid = paging.vaddr.sample_3d<int>( ip );
 				if ( pgid == -1 ) break;
-				
-				auto s_i = paging.block_sampler[ pgid ].sample_3d<float>( ray.o - ip );
-				auto ub_i = transfer_fn.sample_1d<vec4>( s_i );
-				if ( mode == VolumeRenderMode::Partition ) {
-				    vec3 lower = { 1, 0, 0 };
-				    vec3 upper = { 0, 0, 1 };
-					auto v = mix( lower, upper, rank ) *
-						       float( length( vec3( ub_i ) ) );
-					ub_i = vec4( v.x, v.y, v.z, ub_i.w );
-				} else if ( mode == VolumeRenderMode::Paging ) {
-					if ( pgid >= paging.lowest_blkcnt ) {
-						ub_i = vec4( 0, 1, 0, ub_i.w );
+
+				if ( is_uniform_vaddr( pgid ) ) {
+					/* n equal samples composite in closed form */
+					auto s_i = uniform_vaddr_value( pgid );
+					auto n = box_exit_steps( Ray{ ray.o - ip, ray.d }, Box3D{ vec3( 0 ), vec3( 1 ) }, step * step_size );
+					n = min( n, ( nsteps + step_size - 1 ) / step_size );
+					auto ub_i = correct_opacity( classify( s_i, true ), step_size );
+					auto t = pow( 1.f - min( ub_i.w, .9999f ), float( n ) );
+					auto c = ub_i.w > 0.f ? vec3( ub_i ) * ( ( 1.f - t ) / ub_i.w ) : vec3( ub_i ) * float( n );
+					pixel.theta += c * pixel.phi;
+					pixel.phi *= t;
+					pixel.v += vec4( c, 1.f - t ) * ( 1.f - pixel.v.w );
+					pixel.s_prev = s_i;
+					ray.o += ray.d * step * float( step_size * n );
+					nsteps -= n * step_size;
+					if ( pixel.v.w >= opacity_threshold ) { nsteps = 0; }
+					continue;
+				}
+
+				/* march the whole segment inside this block in brick local coordinates */
+				auto &sampler = paging.block_sampler[ pgid ];
+				auto x = ray.o - ip;
+				auto dx = ray.d * step * float( step_size );
+				auto n = box_exit_steps( Ray{ x, ray.d }, Box3D{ vec3( 0 ), vec3( 1 ) }, step * step_size );
+				while ( n > 0 && nsteps > 0 ) {
+					if ( paging.macro_cells ) {
+						Box3D cell_box;
+						auto cell = paging.macro_cell( pgid, x, cell_box );
+						if ( is_transparent( cell ) ) {
+							auto k = box_exit_steps( Ray{ x, ray.d }, cell_box, step * step_size );
+							x += dx * float( k );
+							n -= k;
+							nsteps -= k * step_size;
+							pixel.s_prev = -1.f;
+							continue;
+						}
+					}
+
+					auto s_i = sampler.sample_3d<float>( x );
+					vec4 ub_i;
+					if ( preintegrated && mode == VolumeRenderMode::Default ) {
+						/* already premultiplied over the segment */
+						auto s_f = pixel.s_prev < 0.f ? s_i : pixel.s_prev;
+						ub_i = preint_table.sample_3d<vec4>( vec3( s_f, s_i, .5f ) );
 					} else {
-						ub_i = vec4( 1, 0, 0, ub_i.w );
+						ub_i = classify( s_i, pgid >= paging.lowest_blkcnt );
+					}
+					ub_i = correct_opacity( ub_i, step_size );
+					pixel.theta += vec3( ub_i ) * pixel.phi;
+					pixel.phi *= 1.f - ub_i.w;
+					pixel.v += ub_i * ( 1.f - pixel.v.w );
+
+					x += dx;
+					n -= 1;
+					nsteps -= step_size;
+
+					/* early ray termination */
+					if ( pixel.v.w >= opacity_threshold ) {
+						nsteps = 0;
+						break;
+					}
+
+					auto prev_step_size = step_size;
+					step_size = adapt_step_size( step_size, pixel.s_prev, s_i );
+					pixel.s_prev = s_i;
+					if ( step_size != prev_step_size ) {
+						dx = ray.d * step * float( step_size );
+						n = box_exit_steps( Ray{ x, ray.d }, Box3D{ vec3( 0 ), vec3( 1 ) }, step * step_size );
 					}
 				}
-				ub_i *= vec4( ub_i.w, ub_i.w, ub_i.w, 1 );
-				pixel.theta += vec3( ub_i ) * pixel.phi;
-				pixel.phi *= 1.f - ub_i.w;
-				pixel.v += ub_i * ( 1.f - pixel.v.w );
-				if ( pixel.v.w > 0.93 ) {
-				    step_size = 16;
-				} else if ( pixel.v.w > 0.85 ) {
-				    step_size = 4;
-				}
+				ray.o = ip + x;
+				continue;
 			}
 			ray.o += ray.d * step * float( step_size );
 			nsteps -= step_size;
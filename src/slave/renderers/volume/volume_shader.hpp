@@ -6,26 +6,45 @@
 #include <hydrant/bridge/sampler.hpp>
 #include <hydrant/pixel_template.hpp>
 #include <hydrant/paging/block_paging.hpp>
+#include <hydrant/transfer_fn_lut.hpp>
 #include <volume.schema.hpp>
 
 struct VolumePixel : StdVec4Pixel
 {
 	vec3 theta;
 	float phi;
+	/* previous sample for pre-integration, negative after a gap */
+	float s_prev;
 };
 
+/* premultiplied colour and opacity as normalized 16 bit, the theta and phi of
+   a span are its colour and 1 - opacity so they are not sent. a rounding is at
+   most 1 / 131070 per channel and a frame of n ranks rounds at most
+   log2( n ) + 2 times, far below one 8 bit srgb step */
 struct VolumeFetchPixel
 {
-	vec3 theta;
-	float phi;
-	vec4 val;
+	ushort4 val;
 };
 
+__host__ __device__ inline unsigned short
+  to_unorm16( float x )
+{
+	return (unsigned short)( clamp( x, 0.f, 1.f ) * 65535.f + .5f );
+}
+
 struct VolumeShader : IShader<VolumePixel>
 {
 	VolumeRenderMode mode;
 	float rank;
 	Sampler transfer_fn;
+	TransferFnLut tf_lut;
+	Sampler tf_opaque_prefix;
+	bool preintegrated;
+	Sampler preint_table;
+	float opacity_threshold;
+	bool adaptive;
+	float refine_threshold;
+	int max_step_size;
 	Sampler chebyshev;
 	BlockPaging paging;
 };
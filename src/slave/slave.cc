@@ -1,4 +1,5 @@
 #include <map>
+#include <mutex>
 #include <atomic>
 #include <thread>
 #include <sstream>
@@ -7,6 +8,7 @@
 #include <VMUtils/json_binding.hpp>
 #include <hydrant/basic_renderer.hpp>
 #include <hydrant/config.schema.hpp>
+#include "frame_encoder.hpp"
 #include "slave.hpp"
 
 VM_BEGIN_MODULE( hydrant )
@@ -16,6 +18,7 @@ struct Session : IRenderLoop
 	Session( MpiComm const &comm, int32_t tag, Config &cfg ) :
 		IRenderLoop( cfg.params.camera ),
 		comm( comm ),
+		encoding( cfg.params.encoding ),
 		path( cfg.data_path ),
 		renderer( [&] {
 				auto params = cfg.params.render.params.get<BasicRendererParams>();
@@ -26,11 +29,12 @@ struct Session : IRenderLoop
 		tag( tag )
 	{
 		vm::println( "session #{} started", tag );
-		worker = std::thread( [this] {
+		auto quality = cfg.params.render.quality;
+		worker = std::thread( [this, quality] {
 				this->renderer->realtime_render( *this,
 												 RealtimeRenderOptions{}
 												 .set_comm( this->comm )
-												 .set_quality( RealtimeRenderQuality::Dynamic ) );
+												 .set_quality( quality ) );
 			});
 	}
 
@@ -47,6 +51,10 @@ public:
 		std::istringstream is( diff_str );
 		is >> cfg;
 		camera = cfg.params.camera;
+		{
+			std::unique_lock<std::mutex> lk( encoding_mtx );
+			encoding = cfg.params.encoding;
+		}
 		renderer->update( cfg.params.render.params );
 	}
 
@@ -58,12 +66,15 @@ public:
 		const int leader_rank = 0;
 		if ( comm.rank == leader_rank ) {
 			if ( stop ) return;
-			auto width = frame.get_width();
-			auto height = frame.get_height();
-			auto len = width * height * sizeof( uchar3 );
-			auto msg = MpiInst{}.set_tag( tag ).set_len( len );
+			FrameEncodingConfig opts;
+			{
+				std::unique_lock<std::mutex> lk( encoding_mtx );
+				opts = encoding;
+			}
+			encoder.encode( frame, opts, packet );
+			auto msg = MpiInst{}.set_tag( tag ).set_len( packet.size() );
 			MPI_Send( &msg, sizeof( msg ), MPI_CHAR, 0, tag, MPI_COMM_WORLD );
-			MPI_Send( &frame.at( 0, 0 ), len, MPI_CHAR, 0, tag, MPI_COMM_WORLD );
+			MPI_Send( packet.data(), packet.size(), MPI_CHAR, 0, tag, MPI_COMM_WORLD );
 		}
 	}
 
@@ -71,6 +82,10 @@ private:
 	bool stop = false;
 	MpiComm comm;
 	Config cfg;
+	std::mutex encoding_mtx;
+	FrameEncodingConfig encoding;
+	FrameEncoder encoder;
+	std::vector<char> packet;
 	cppfs::FilePath path;
 	vm::Box<IRenderer> renderer;
 	std::thread worker;
@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
+#include <glog/logging.h>
+#include <VMUtils/timer.hpp>
+#include <hydrant/unarchiver.hpp>
+#include <hydrant/value_range.hpp>
+
+VM_BEGIN_MODULE( hydrant )
+
+using namespace std;
+using namespace vol;
+
+VM_EXPORT
+{
+	shared_ptr<ValueRangeThumbnail> ValueRangeThumbnail::load_or_build( Dataset const &dataset )
+	{
+		auto &lvl0 = dataset.meta.sample_levels[ 0 ];
+		auto path = dataset.root.resolve( lvl0.path ).resolved() + ".range";
+		auto thumb = make_shared<ValueRangeThumbnail>( uvec3( lvl0.dim.x, lvl0.dim.y, lvl0.dim.z ) );
+		/* every slave loads or builds on its own, renderers are created outside
+		   of any collective. concurrent builds are safe since dump renames a
+		   private temp file over the cache */
+		if ( !thumb->load( path ) ) {
+			LOG( INFO ) << vm::fmt( "building value range thumbnail for {}", lvl0.path );
+			vm::Timer::Scoped timer( [&]( auto dt ) {
+				LOG( INFO ) << vm::fmt( "value range thumbnail built in {}ms", dt.ns().cnt() / 1000000 );
+			} );
+			thumb->build( dataset );
+			thumb->dump( path );
+		}
+		return thumb;
+	}
+
+	bool ValueRangeThumbnail::load( string const &path )
+	{
+		ifstream is( path, ios::binary );
+		if ( !is.is_open() ) { return false; }
+		uvec3 d;
+		is.read( reinterpret_cast<char *>( &d ), sizeof( d ) );
+		if ( !is || d != this->dim() ) {
+			LOG( WARNING ) << vm::fmt( "value range thumbnail '{}' mismatch, rebuilding", path );
+			return false;
+		}
+		is.read( reinterpret_cast<char *>( this->data() ), this->bytes() );
+		return bool( is );
+	}
+
+	/* written aside and renamed over, so a reader never sees a torn file. on
+	   a read only dataset the thumbnail just stays in memory */
+	void ValueRangeThumbnail::dump( string const &path ) const
+	{
+		auto tmp = vm::fmt( "{}.{}.tmp", path, getpid() );
+		ofstream os( tmp, ios::binary );
+		if ( os.is_open() ) {
+			auto d = this->dim();
+			os.write( reinterpret_cast<char const *>( &d ), sizeof( d ) );
+			os.write( reinterpret_cast<char const *>( this->data() ), this->bytes() );
+			os.close();
+			if ( os && std::rename( tmp.c_str(), path.c_str() ) == 0 ) { return; }
+			std::remove( tmp.c_str() );
+		}
+		LOG( WARNING ) << vm::fmt( "failed to cache value range thumbnail to '{}'", path );
+	}
+
+	void ValueRangeThumbnail::build( Dataset const &dataset )
+	{
+		auto &lvl0 = dataset.meta.sample_levels[ 0 ];
+		auto pad_bs = dataset.meta.block_size + 2 * dataset.meta.padding;
+		HostBuffer3D<unsigned char> buf( uvec3( pad_bs ) );
+
+		vector<Idx> idxs;
+		idxs.reserve( lvl0.dim.total() );
+		for ( auto idx = Idx{}; idx.z != lvl0.dim.z; ++idx.z ) {
+			for ( idx.y = 0; idx.y != lvl0.dim.y; ++idx.y ) {
+				for ( idx.x = 0; idx.x != lvl0.dim.x; ++idx.x ) {
+					idxs.emplace_back( idx );
+				}
+			}
+		}
+		sort( idxs.begin(), idxs.end() );
+
+		/* decode on host, this runs once per dataset */
+		Unarchiver unarchiver( UnarchiverOptions{}
+								 .set_path( dataset.root.resolve( lvl0.path ).resolved() ) );
+		size_t nbytes = 0, block_bytes = buf.bytes();
+		unarchiver.unarchive(
+		  idxs,
+		  [&]( Idx const &idx, VoxelStreamPacket const &pkt ) {
+			  pkt.append_to( buf.view_1d() );
+			  nbytes += pkt.length;
+			  if ( nbytes >= block_bytes ) {
+				  auto mm = minmax_element( buf.data(), buf.data() + block_bytes );
+				  ( *this )[ uvec3( idx.x, idx.y, idx.z ) ] =
+					vec2( *mm.first, *mm.second ) / 255.f;
+				  nbytes = 0;
+			  }
+		  } );
+	}
+}
+
+VM_END_MODULE()
@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stbi/stb_image_write.h>
 #include <glog/logging.h>
 #include "Image.hpp"
@@ -16,10 +17,7 @@ namespace voxer {
 		void stbi_write_func(void *context, void *data, int size) {
 			auto image = reinterpret_cast<vector<uint8_t> *>(context);
 			auto encoded = reinterpret_cast<uint8_t *>(data);
-			for (int i = 0; i < size; i++) {
-				image->push_back(encoded[i]);
-				  
-			}
+			image->insert(image->end(), encoded, encoded + size);
 			
 		}
 
@@ -42,10 +40,8 @@ namespace voxer {
 		auto quality_value = static_cast<int>(quality);
 		assert(quality_value >= 0 && quality_value <= 100);
 
-		if (flip_vertically) {
-			stbi_flip_vertically_on_write(1);
-			  
-		}
+		/* the flag is global in stb, set it on every call */
+		stbi_flip_vertically_on_write(flip_vertically ? 1 : 0);
 
 		auto res = stbi_write_jpg_to_func(
 										  stbi_write_func, reinterpret_cast<void *>(&image.data), width, height,
@@ -60,7 +56,7 @@ namespace voxer {
 		const auto delta = chrono::duration_cast<chrono::milliseconds>(
 																	   chrono::steady_clock::now() - start
 																	   );
-		LOG( INFO ) << (to_string(delta.count()) + " ms");
+		VLOG( 1 ) << (to_string(delta.count()) + " ms");
 
 		return image;
 		
@@ -15,5 +15,11 @@ struct IsosurfaceRendererParams : vm::json::Serializable<IsosurfaceRendererParam
 	VM_JSON_FIELD( IsosurfaceRenderMode, mode ) = IsosurfaceRenderMode::Color;
 	VM_JSON_FIELD( vec3, surface_color ) = { 1.f, 1.f, 1.f };
 	VM_JSON_FIELD( float, isovalue ) = 0.5f;
+	/* march stride in steps, macro cells whose range holds the isovalue are
+	   marched at single steps. crossings are refined by secant iterations */
+	VM_JSON_FIELD( int, coarse_step ) = 1;
+	VM_JSON_FIELD( int, refine_iterations ) = 4;
+	/* average normals over the 2x2x2 voxel neighbourhood, cpu only */
+	VM_JSON_FIELD( bool, smooth_normals ) = false;
 	VM_JSON_FIELD( std::size_t, mem_limit_mb ) = 1024 * 2;
 };
@@ -18,4 +18,12 @@ struct VolumeRendererParams : vm::json::Serializable<VolumeRendererParams>
 	VM_JSON_FIELD( VolumeRenderMode, mode ) = VolumeRenderMode::Default;
 	VM_JSON_FIELD( TransferFnConfig, transfer_fn );
 	VM_JSON_FIELD( std::size_t, mem_limit_mb ) = 1024 * 2;
+	/* look up ( front, back ) sample pairs in a pre-integrated table, allows lower sample rates */
+	VM_JSON_FIELD( bool, preintegrate ) = false;
+	/* rays stop once accumulated opacity reaches this */
+	VM_JSON_FIELD( float, opacity_threshold ) = 0.99f;
+	/* vary the stride between 1 and max_step_size steps by the change between samples */
+	VM_JSON_FIELD( bool, adaptive_sampling ) = false;
+	VM_JSON_FIELD( float, refine_threshold ) = 0.02f;
+	VM_JSON_FIELD( int, max_step_size ) = 4;
 };